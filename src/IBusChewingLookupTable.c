@@ -2,50 +2,135 @@
 #include "IBusChewingUtil.h"
 #include "MakerDialogUtil.h"
 
-IBusLookupTable *ibus_chewing_lookup_table_new(ChewingContext *context) {
+/* Candidate texts shared by all lookup tables, least recently used first */
+#ifndef CANDIDATE_TEXTS_MAX
+#define CANDIDATE_TEXTS_MAX 4096
+#endif
+
+typedef struct {
+    gchar *candidate;
+    IBusText *iText;
+} CandidateText;
+
+static GMutex candidateTextsLock;
+static GHashTable *candidateTexts = NULL;
+static GQueue candidateTextsLru = G_QUEUE_INIT;
+static IBusChewingCandidateTextStats candidateTextsStats = {0};
+
+static void candidate_text_free(gpointer data) {
+    CandidateText *candidateText = data;
+
+    g_free(candidateText->candidate);
+    g_object_unref(candidateText->iText);
+    g_free(candidateText);
+}
+
+/*
+ * Return the shared IBusText of candidate, creating it on a miss.
+ * The text must not be modified; the caller gets a new reference.
+ */
+static IBusText *candidate_text_intern(const gchar *candidate) {
+    IBusText *iText;
+
+    g_mutex_lock(&candidateTextsLock);
+    if (candidateTexts == NULL) {
+        candidateTexts = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+    GList *link = g_hash_table_lookup(candidateTexts, candidate);
+
+    if (link != NULL) {
+        candidateTextsStats.hits++;
+        g_queue_unlink(&candidateTextsLru, link);
+        g_queue_push_tail_link(&candidateTextsLru, link);
+    } else {
+        CandidateText *candidateText = g_new(CandidateText, 1);
+
+        candidateTextsStats.misses++;
+        candidateText->candidate = g_strdup(candidate);
+        candidateText->iText = g_object_ref_sink(ibus_text_new_from_string(candidate));
+        g_queue_push_tail(&candidateTextsLru, candidateText);
+        link = candidateTextsLru.tail;
+        g_hash_table_insert(candidateTexts, candidateText->candidate, link);
+
+        if (candidateTextsLru.length > CANDIDATE_TEXTS_MAX) {
+            CandidateText *oldest = g_queue_pop_head(&candidateTextsLru);
+
+            g_hash_table_remove(candidateTexts, oldest->candidate);
+            candidate_text_free(oldest);
+            candidateTextsStats.evictions++;
+        }
+    }
+    iText = g_object_ref(((CandidateText *)link->data)->iText);
+    g_mutex_unlock(&candidateTextsLock);
+    return iText;
+}
+
+void ibus_chewing_lookup_table_get_text_stats(IBusChewingCandidateTextStats *stats) {
+    g_mutex_lock(&candidateTextsLock);
+    *stats = candidateTextsStats;
+    stats->size = candidateTextsLru.length;
+    g_mutex_unlock(&candidateTextsLock);
+}
+
+IBusLookupTable *ibus_chewing_lookup_table_new() {
     guint size = 10;
     gboolean cursorShow = TRUE;
     gboolean wrapAround = TRUE;
-    IBusLookupTable *iTable = ibus_lookup_table_new(size, 0, cursorShow, wrapAround);
-
-    ibus_chewing_lookup_table_resize(iTable, context);
 
-    return iTable;
+    return ibus_lookup_table_new(size, 0, cursorShow, wrapAround);
 }
 
-void ibus_chewing_lookup_table_resize(IBusLookupTable *iTable, ChewingContext *context) {
+void ibus_chewing_lookup_table_resize(IBusLookupTable *iTable, ChewingContext *context,
+                                      const IBusChewingLookupTableConfig *config) {
+    g_return_if_fail(config->selKeys != NULL);
+
     gint selKSym[MAX_SELKEY];
-    g_autoptr(GSettings) settings = g_settings_new(QUOTE_ME(PROJECT_SCHEMA_ID));
-    g_autofree char *selKeyStr = g_settings_get_string(settings, "sel-keys");
-    guint candPerPage = g_settings_get_uint(settings, "cand-per-page");
+    const gchar *selKeyStr = config->selKeys;
 
     /* Users are allowed to specify their own selKeys,
      * we have to check the length and take the smaller one.
      */
-    int len = MIN(strlen(selKeyStr), candPerPage);
+    int len = MIN(strlen(selKeyStr), config->candPerPage);
     int i;
     IBusText *iText;
 
+    for (i = 0; i < len; i++) {
+        selKSym[i] = (gint)selKeyStr[i];
+    }
     if (iTable != NULL) {
         ibus_lookup_table_set_page_size(iTable, len);
 
         for (i = 0; i < len; i++) {
-            selKSym[i] = (gint)selKeyStr[i];
-
             iText = g_object_ref_sink(ibus_text_new_from_printf("%c.", toupper(selKeyStr[i])));
             ibus_lookup_table_set_label(iTable, i, iText);
             g_object_unref(iText);
         }
+        ibus_lookup_table_set_orientation(iTable, config->vertical);
     }
     chewing_set_candPerPage(context, len);
     chewing_set_selKey(context, selKSym, MAX_SELKEY);
+}
+
+/* Whether iTable holds exactly the candidates of current list */
+static gboolean lookup_table_is_current(IBusLookupTable *iTable, ChewingContext *context,
+                                        gint totalChoice) {
+    guint tableLen = ibus_lookup_table_get_number_of_candidates(iTable);
 
-    gboolean verticalLookupTable = g_settings_get_boolean(settings, "vertical-lookup-table");
+    if (tableLen != (guint)totalChoice) {
+        return FALSE;
+    }
+    for (guint i = 0; i < tableLen; i++) {
+        const gchar *candidate = chewing_cand_string_by_index_static(context, i);
 
-    ibus_lookup_table_set_orientation(iTable, verticalLookupTable);
+        if (strcmp(ibus_lookup_table_get_candidate(iTable, i)->text, candidate) != 0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
 }
 
-guint ibus_chewing_lookup_table_update(IBusLookupTable *iTable, ChewingContext *context) {
+guint ibus_chewing_lookup_table_update(IBusLookupTable *iTable, ChewingContext *context,
+                                       gboolean *changed) {
     IBusText *iText = NULL;
     gint i;
     gint choicePerPage = chewing_cand_ChoicePerPage(context);
@@ -57,19 +142,50 @@ guint ibus_chewing_lookup_table_update(IBusLookupTable *iTable, ChewingContext *
                      "choicePerPage=%d, totalChoice=%d, currentPage=%d",
                      choicePerPage, totalChoice, currentPage);
 
-    ibus_lookup_table_clear(iTable);
-    chewing_cand_Enumerate(context);
-    for (i = 0; i < choicePerPage; i++) {
-        if (chewing_cand_hasNext(context)) {
-            gchar *candidate = chewing_cand_String(context);
-
-            iText = g_object_ref_sink(ibus_text_new_from_string(candidate));
-            ibus_lookup_table_append_candidate(iTable, iText);
-            chewing_free(candidate);
-            g_object_unref(iText);
-        } else {
-            break;
+    if (lookup_table_is_current(iTable, context, totalChoice)) {
+        if (changed != NULL) {
+            *changed = FALSE;
         }
+        return ibus_lookup_table_get_number_of_candidates(iTable);
+    }
+
+    ibus_lookup_table_clear(iTable);
+    for (i = 0; i < totalChoice; i++) {
+        const gchar *candidate = chewing_cand_string_by_index_static(context, i);
+
+        iText = candidate_text_intern(candidate);
+        ibus_lookup_table_append_candidate(iTable, iText);
+        g_object_unref(iText);
+    }
+    if (changed != NULL) {
+        *changed = TRUE;
     }
     return i;
 }
+
+guint ibus_chewing_lookup_table_get_page(IBusLookupTable *iTable) {
+    return ibus_lookup_table_get_cursor_pos(iTable) / ibus_lookup_table_get_page_size(iTable);
+}
+
+guint ibus_chewing_lookup_table_get_total_pages(IBusLookupTable *iTable) {
+    guint pageSize = ibus_lookup_table_get_page_size(iTable);
+
+    return (ibus_lookup_table_get_number_of_candidates(iTable) + pageSize - 1) / pageSize;
+}
+
+guint ibus_chewing_lookup_table_get_page_length(IBusLookupTable *iTable) {
+    guint pageSize = ibus_lookup_table_get_page_size(iTable);
+    guint pageStart = ibus_chewing_lookup_table_get_page(iTable) * pageSize;
+
+    return MIN(pageSize, ibus_lookup_table_get_number_of_candidates(iTable) - pageStart);
+}
+
+void ibus_chewing_lookup_table_set_page(IBusLookupTable *iTable, guint page) {
+    guint totalPages = ibus_chewing_lookup_table_get_total_pages(iTable);
+
+    if (totalPages == 0) {
+        return;
+    }
+    page = MIN(page, totalPages - 1);
+    ibus_lookup_table_set_cursor_pos(iTable, page * ibus_lookup_table_get_page_size(iTable));
+}
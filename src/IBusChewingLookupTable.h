@@ -36,12 +36,95 @@
 #include <chewing.h>
 #include <ibus.h>
 
-IBusLookupTable *ibus_chewing_lookup_table_new(ChewingContext *context);
+/**
+ * IBusChewingLookupTableConfig:
+ * @selKeys:     Selection keys, e.g. "1234567890".
+ * @candPerPage: Number of candidates per page.
+ * @vertical:    Whether to show the lookup table vertically.
+ *
+ * Settings that determine the lookup table layout.
+ */
+typedef struct {
+    const gchar *selKeys;
+    guint candPerPage;
+    gboolean vertical;
+} IBusChewingLookupTableConfig;
+
+/**
+ * IBusChewingCandidateTextStats:
+ * @hits:      Candidates whose IBusText was found in the intern table.
+ * @misses:    Candidates whose IBusText had to be created.
+ * @evictions: Least recently used IBusTexts dropped to stay within
+ *             CANDIDATE_TEXTS_MAX.
+ * @size:      IBusTexts in the intern table.
+ *
+ * Counters of the process-wide table of candidate IBusTexts,
+ * which ibus_chewing_lookup_table_update() shares between refreshes and
+ * lookup tables.
+ */
+typedef struct {
+    guint64 hits;
+    guint64 misses;
+    guint64 evictions;
+    guint size;
+} IBusChewingCandidateTextStats;
+
+IBusLookupTable *ibus_chewing_lookup_table_new();
+
+/**
+ * ibus_chewing_lookup_table_get_text_stats:
+ * @stats: (out): Filled with the current counters.
+ */
+void ibus_chewing_lookup_table_get_text_stats(IBusChewingCandidateTextStats *stats);
 
 void ibus_chewing_lookup_table_resize(IBusLookupTable *iTable,
-                                      ChewingContext *context);
+                                      ChewingContext *context,
+                                      const IBusChewingLookupTableConfig *config);
 
+/**
+ * ibus_chewing_lookup_table_update:
+ * @iTable:  Lookup table to update.
+ * @context: Chewing context that holds the candidates.
+ * @changed: (out) (optional): Whether the candidates in @iTable changed.
+ * @returns: Number of candidates in @iTable.
+ *
+ * Put all the candidates of the current candidate list into @iTable,
+ * so turning pages needs no call to libchewing.
+ * @iTable is left untouched if it already holds the same candidates.
+ * Callers place the cursor with ibus_chewing_lookup_table_set_page().
+ */
 guint ibus_chewing_lookup_table_update(IBusLookupTable *iTable,
-                                       ChewingContext *context);
+                                       ChewingContext *context,
+                                       gboolean *changed);
+
+/**
+ * ibus_chewing_lookup_table_get_page:
+ * @iTable:  A lookup table.
+ * @returns: Page of the cursor, starting from 0.
+ */
+guint ibus_chewing_lookup_table_get_page(IBusLookupTable *iTable);
+
+/**
+ * ibus_chewing_lookup_table_get_total_pages:
+ * @iTable:  A lookup table.
+ * @returns: Number of pages, 0 if @iTable is empty.
+ */
+guint ibus_chewing_lookup_table_get_total_pages(IBusLookupTable *iTable);
+
+/**
+ * ibus_chewing_lookup_table_get_page_length:
+ * @iTable:  A lookup table.
+ * @returns: Number of candidates on the page of the cursor.
+ */
+guint ibus_chewing_lookup_table_get_page_length(IBusLookupTable *iTable);
+
+/**
+ * ibus_chewing_lookup_table_set_page:
+ * @iTable:  A lookup table.
+ * @page:    Page to show, clamped to the last page.
+ *
+ * Move the cursor to the first candidate of @page.
+ */
+void ibus_chewing_lookup_table_set_page(IBusLookupTable *iTable, guint page);
 
 #endif /* _IBUS_CHEWING_LOOKUP_TABLE_H_ */
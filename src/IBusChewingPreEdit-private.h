@@ -25,6 +25,7 @@
  * Put it here so they can be tested.
  */
 #pragma once
+#include "IBusChewingTrace.h"
 
 /*== Frequent used shortcut ==*/
 #define cursor_current chewing_cursor_Current(self->context)
@@ -79,12 +80,35 @@
 #define event_process_or_ignore(cond) (cond) ? EVENT_RESPONSE_PROCESS : EVENT_RESPONSE_IGNORE
 
 #define handle_log(funcName)                                                                       \
+    IBUS_CHEWING_TRACE(handler, funcName);                                                         \
     IBUS_CHEWING_LOG(INFO, "* self_handle_%s(-,%x(%s),%x(%s))", funcName, kSym,                    \
                      key_sym_get_name(kSym), unmaskedMod, modifiers_to_string(unmaskedMod));
 
+/* Call into libchewing between the chewing_entry and chewing_return probes */
+#define chewing_call(call)                                                                         \
+    ({                                                                                             \
+        IBUS_CHEWING_TRACE(chewing_entry);                                                         \
+        gint _chewingRet = (call);                                                                 \
+        IBUS_CHEWING_TRACE(chewing_return, _chewingRet);                                           \
+        _chewingRet;                                                                               \
+    })
+
 KSym self_key_sym_fix(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod);
 
 EventResponse self_handle_key_sym_default(IBusChewingPreEdit *self, KSym kSym,
                                           KeyModifiers unmaskedMod);
 
 void ibus_chewing_pre_edit_update(IBusChewingPreEdit *self);
+
+/**
+ * self_key_sym_find_key_handling_rule:
+ * @kSym: Key symbol.
+ * @returns: The first rule in keyHandlingRules that covers @kSym.
+ *
+ * Constant time lookup through the dispatch tables that
+ * ibus_chewing_pre_edit_new() builds.
+ * self_key_sym_find_key_handling_rule_linear() is the reference
+ * implementation that scans keyHandlingRules.
+ */
+KeyHandlingRule *self_key_sym_find_key_handling_rule(KSym kSym);
+KeyHandlingRule *self_key_sym_find_key_handling_rule_linear(KSym kSym);
@@ -9,6 +9,57 @@
  * Methods
  */
 
+static void self_key_dispatch_init();
+static void update_pass_through(IBusChewingPreEdit *self);
+
+/* Context built by ibus_chewing_pre_edit_warm_up(), taken by the first pre-edit */
+static GThread *warmUpThread = NULL;
+
+static gpointer warm_up_thread([[maybe_unused]] gpointer data) {
+    return chewing_new();
+}
+
+void ibus_chewing_pre_edit_warm_up() {
+    g_autoptr(GError) error = NULL;
+
+    if (warmUpThread != NULL) {
+        return;
+    }
+    warmUpThread = g_thread_try_new("chewing-warm-up", warm_up_thread, NULL, &error);
+    if (warmUpThread == NULL) {
+        IBUS_CHEWING_LOG(WARN, "warm_up() cannot start thread: %s", error->message);
+    }
+}
+
+static ChewingContext *chewing_context_new() {
+    if (warmUpThread != NULL) {
+        ChewingContext *context = g_thread_join(warmUpThread);
+
+        warmUpThread = NULL;
+        if (context != NULL) {
+            IBUS_CHEWING_LOG(INFO, "chewing_context_new() use warmed up context");
+            return context;
+        }
+    }
+    return chewing_new();
+}
+
+/* A phrase to learn, [from, to) are character offsets in the buffer */
+typedef struct {
+    glong from;
+    glong to;
+    gchar *phrase;
+    gchar *bopomofo;
+} LearnPhrase;
+
+static void learn_phrase_free(gpointer data) {
+    LearnPhrase *learnPhrase = data;
+
+    g_free(learnPhrase->phrase);
+    g_free(learnPhrase->bopomofo);
+    g_free(learnPhrase);
+}
+
 IBusChewingPreEdit *ibus_chewing_pre_edit_new() {
     IBusChewingPreEdit *self = g_new0(IBusChewingPreEdit, 1);
 
@@ -18,13 +69,31 @@ IBusChewingPreEdit *ibus_chewing_pre_edit_new() {
     self->keyLast = 0;
     self->bpmfLen = 0;
     self->wordLen = 0;
+    self->charOffsets = g_array_sized_new(FALSE, FALSE, sizeof(gsize), IBUS_CHEWING_MAX_WORD + 1);
+    g_array_set_size(self->charOffsets, 1);
+    g_array_index(self->charOffsets, gsize, 0) = 0;
+    self->bpmfOffset = 0;
+    self->bpmfBytes = 0;
+    self->tableGeneration = 0;
+    self->candPage = 0;
+    self->passThrough = FALSE;
+    self->deferLearning = FALSE;
+    self->learnSnapshot = g_ptr_array_new_with_free_func(learn_phrase_free);
+    self->learnQueue = g_ptr_array_new_with_free_func(learn_phrase_free);
+    self->keymap = NULL;
+    self->keySymTable = NULL;
     self->engine = NULL;
 
-    self->context = chewing_new();
+    self_key_dispatch_init();
+    self->context = chewing_context_new();
     // TODO add default mode setting
     chewing_set_ChiEngMode(self->context, CHINESE_MODE);
+    self->applied.easySymbolInput = chewing_get_easySymbolInput(self->context);
+    self->applied.escCleanAllBuf = chewing_get_escCleanAllBuf(self->context);
+    self->config = self->applied;
+    ibus_chewing_pre_edit_sync_sel_keys(self);
 
-    self->iTable = g_object_ref_sink(ibus_chewing_lookup_table_new(self->context));
+    self->iTable = g_object_ref_sink(ibus_chewing_lookup_table_new());
     return self;
 }
 
@@ -33,6 +102,11 @@ void ibus_chewing_pre_edit_free(IBusChewingPreEdit *self) {
     chewing_delete(self->context);
     g_string_free(self->preEdit, TRUE);
     g_string_free(self->outgoing, TRUE);
+    g_array_free(self->charOffsets, TRUE);
+    g_ptr_array_unref(self->learnSnapshot);
+    g_ptr_array_unref(self->learnQueue);
+    g_clear_object(&self->keymap);
+    g_free(self->keySymTable);
     ibus_lookup_table_clear(self->iTable);
     g_object_unref(self->iTable);
     g_free(self);
@@ -45,6 +119,175 @@ gchar *ibus_chewing_pre_edit_get_bopomofo_string(IBusChewingPreEdit *self) {
     return g_strdup(buf);
 }
 
+/* Queue the characters [from, to) of buf as a phrase of the snapshot */
+static void self_learn_snapshot_add(IBusChewingPreEdit *self, const gchar *buf,
+                                    const gint *phoneIndex, const unsigned short *phoneSeq,
+                                    glong from, glong to) {
+    GString *bopomofo = g_string_new(NULL);
+
+    for (gint j = phoneIndex[from]; j < phoneIndex[to]; j++) {
+        gchar syllable[UTF8_MAX_BYTES * 8];
+
+        chewing_phone_to_bopomofo(phoneSeq[j], syllable, sizeof(syllable));
+        if (bopomofo->len > 0) {
+            g_string_append_c(bopomofo, ' ');
+        }
+        g_string_append(bopomofo, syllable);
+    }
+    LearnPhrase *learnPhrase = g_new(LearnPhrase, 1);
+
+    learnPhrase->from = from;
+    learnPhrase->to = to;
+    learnPhrase->phrase = g_utf8_substring(buf, from, to);
+    learnPhrase->bopomofo = g_string_free(bopomofo, FALSE);
+    g_ptr_array_add(self->learnSnapshot, learnPhrase);
+}
+
+/**
+ * self_learn_snapshot:
+ *
+ * Remember what libchewing auto-learning would learn from the buffer,
+ * as libchewing does not tell which part a commit took: its phrases,
+ * and each run of characters between them joined into one.
+ * Called before every key when learning is deferred.
+ */
+static void self_learn_snapshot(IBusChewingPreEdit *self) {
+    g_ptr_array_set_size(self->learnSnapshot, 0);
+    if (!self->deferLearning || !chewing_buffer_Check(self->context)) {
+        return;
+    }
+    const gchar *buf = chewing_buffer_String_static(self->context);
+    glong bufLen = g_utf8_strlen(buf, -1);
+    g_autofree gint *phoneIndex = g_new(gint, bufLen + 1);
+    g_autofree gboolean *inPhrase = g_new0(gboolean, bufLen);
+    gint phoneLen = 0;
+    glong i = 0;
+
+    /* Only Han characters have phones, symbols in the buffer do not */
+    for (const gchar *p = buf; *p != '\0'; p = g_utf8_next_char(p), i++) {
+        phoneIndex[i] = phoneLen;
+        if (g_unichar_get_script(g_utf8_get_char(p)) == G_UNICODE_SCRIPT_HAN) {
+            phoneLen++;
+        }
+    }
+    phoneIndex[bufLen] = phoneLen;
+    if (phoneLen != chewing_get_phoneSeqLen(self->context)) {
+        IBUS_CHEWING_LOG(INFO, "self_learn_snapshot() phones do not match |%s|", buf);
+        return;
+    }
+    unsigned short *phoneSeq = chewing_get_phoneSeq(self->context);
+    IntervalType interval;
+
+    chewing_interval_Enumerate(self->context);
+    while (chewing_interval_hasNext(self->context)) {
+        chewing_interval_Get(self->context, &interval);
+        if (interval.to - interval.from < 2 || interval.to > bufLen ||
+            phoneIndex[interval.to] - phoneIndex[interval.from] != interval.to - interval.from) {
+            continue;
+        }
+        self_learn_snapshot_add(self, buf, phoneIndex, phoneSeq, interval.from, interval.to);
+        for (i = interval.from; i < interval.to; i++) {
+            inPhrase[i] = TRUE;
+        }
+    }
+
+    /* Single characters, a run of them is learned as a phrase as libchewing does */
+#define has_phone(i) (phoneIndex[(i) + 1] != phoneIndex[i])
+    for (glong from = 0; from < bufLen;) {
+        if (inPhrase[from] || !has_phone(from)) {
+            from++;
+            continue;
+        }
+        glong to = from + 1;
+
+        while (to < bufLen && to - from < MAX_PHRASE_LEN && !inPhrase[to] && has_phone(to)) {
+            to++;
+        }
+        self_learn_snapshot_add(self, buf, phoneIndex, phoneSeq, from, to);
+        from = to;
+    }
+#undef has_phone
+    chewing_free(phoneSeq);
+}
+
+/* Queue the snapshot phrases that commitStr, the start of the buffer, took */
+static void self_learn_commit(IBusChewingPreEdit *self, const gchar *commitStr) {
+    glong commitLen = g_utf8_strlen(commitStr, -1);
+
+    for (guint i = 0; i < self->learnSnapshot->len;) {
+        LearnPhrase *learnPhrase = g_ptr_array_index(self->learnSnapshot, i);
+
+        if (learnPhrase->to <= commitLen &&
+            g_str_has_prefix(g_utf8_offset_to_pointer(commitStr, learnPhrase->from),
+                             learnPhrase->phrase)) {
+            if (ibus_chewing_pre_edit_learn_is_full(self)) {
+                /* The engine flushes a full queue when idle, never in the key path */
+                IBUS_CHEWING_LOG(INFO, "self_learn_commit() queue full, dropped |%s|",
+                                 ((LearnPhrase *)g_ptr_array_index(self->learnQueue, 0))->phrase);
+                g_ptr_array_remove_index(self->learnQueue, 0);
+            }
+            g_ptr_array_add(self->learnQueue, g_ptr_array_steal_index(self->learnSnapshot, i));
+        } else {
+            i++;
+        }
+    }
+    g_ptr_array_set_size(self->learnSnapshot, 0);
+}
+
+guint ibus_chewing_pre_edit_learn_flush(IBusChewingPreEdit *self) {
+    guint learned = self->learnQueue->len;
+
+    for (guint i = 0; i < learned; i++) {
+        LearnPhrase *learnPhrase = g_ptr_array_index(self->learnQueue, i);
+
+        chewing_userphrase_add(self->context, learnPhrase->phrase, learnPhrase->bopomofo);
+    }
+    g_ptr_array_set_size(self->learnQueue, 0);
+    IBUS_CHEWING_LOG(INFO, "ibus_chewing_pre_edit_learn_flush() learned=%u", learned);
+    return learned;
+}
+
+void ibus_chewing_pre_edit_set_defer_learning(IBusChewingPreEdit *self, gboolean deferLearning) {
+    if (!deferLearning) {
+        ibus_chewing_pre_edit_learn_flush(self);
+        g_ptr_array_set_size(self->learnSnapshot, 0);
+    }
+    self->deferLearning = deferLearning;
+    chewing_set_autoLearn(self->context, deferLearning ? AUTOLEARN_DISABLED : AUTOLEARN_ENABLED);
+}
+
+/* Change the options of libchewing only when they differ */
+static void self_apply_easy_symbol_input(IBusChewingPreEdit *self, gint easySymbolInput) {
+    if (self->applied.easySymbolInput != easySymbolInput) {
+        chewing_set_easySymbolInput(self->context, easySymbolInput);
+        self->applied.easySymbolInput = easySymbolInput;
+    }
+}
+
+static void self_apply_esc_clean_all_buf(IBusChewingPreEdit *self, gint escCleanAllBuf) {
+    if (self->applied.escCleanAllBuf != escCleanAllBuf) {
+        chewing_set_escCleanAllBuf(self->context, escCleanAllBuf);
+        self->applied.escCleanAllBuf = escCleanAllBuf;
+    }
+}
+
+void ibus_chewing_pre_edit_set_easy_symbol_input(IBusChewingPreEdit *self,
+                                                 gboolean easySymbolInput) {
+    self->config.easySymbolInput = easySymbolInput ? 1 : 0;
+}
+
+void ibus_chewing_pre_edit_set_esc_clean_all_buf(IBusChewingPreEdit *self,
+                                                 gboolean escCleanAllBuf) {
+    self->config.escCleanAllBuf = escCleanAllBuf ? 1 : 0;
+}
+
+void ibus_chewing_pre_edit_sync_sel_keys(IBusChewingPreEdit *self) {
+    gint *selKeys = chewing_get_selKey(self->context);
+
+    memcpy(self->selKeys, selKeys, sizeof(self->selKeys));
+    chewing_free(selKeys);
+}
+
 void ibus_chewing_pre_edit_update_outgoing(IBusChewingPreEdit *self) {
     if (chewing_commit_Check(self->context)) {
         /* commit_Check=1 means new commit available */
@@ -52,6 +295,9 @@ void ibus_chewing_pre_edit_update_outgoing(IBusChewingPreEdit *self) {
 
         IBUS_CHEWING_LOG(INFO, "commitStr=|%s|\n", commitStr);
         g_string_append(self->outgoing, commitStr);
+        if (self->learnSnapshot->len > 0) {
+            self_learn_commit(self, commitStr);
+        }
 
         chewing_free(commitStr);
         chewing_ack(self->context);
@@ -61,44 +307,97 @@ void ibus_chewing_pre_edit_update_outgoing(IBusChewingPreEdit *self) {
                      self->outgoing->str);
 }
 
+#define utf8_is_continuation(c) (((c) & 0xc0) == 0x80)
+
+/*
+ * Replace the part of buffer (preEdit without bopomofo) that differs
+ * from newBuf, and keep charOffsets in sync.
+ * Typing, selecting and deleting usually change only a few characters
+ * around the cursor, so the common prefix and suffix are left untouched.
+ */
+static void self_buffer_apply(IBusChewingPreEdit *self, const gchar *newBuf) {
+    GString *buf = self->preEdit;
+    gsize oldLen = buf->len;
+    gsize newLen = strlen(newBuf);
+    gsize prefix = 0;
+    gsize suffix = 0;
+
+    while (prefix < oldLen && prefix < newLen && buf->str[prefix] == newBuf[prefix]) {
+        prefix++;
+    }
+    if (prefix == oldLen && prefix == newLen) {
+        return;
+    }
+    while (prefix > 0 && ((prefix < oldLen && utf8_is_continuation(buf->str[prefix])) ||
+                          (prefix < newLen && utf8_is_continuation(newBuf[prefix])))) {
+        prefix--;
+    }
+    while (suffix < oldLen - prefix && suffix < newLen - prefix &&
+           buf->str[oldLen - suffix - 1] == newBuf[newLen - suffix - 1]) {
+        suffix++;
+    }
+    while (suffix > 0 && utf8_is_continuation(newBuf[newLen - suffix])) {
+        suffix--;
+    }
+
+    /* Character indexes of the changed span in the old buffer */
+    GArray *offsets = self->charOffsets;
+    guint first = 0;
+    guint last;
+
+    while (g_array_index(offsets, gsize, first) < prefix) {
+        first++;
+    }
+    for (last = first; g_array_index(offsets, gsize, last) < oldLen - suffix; last++) {
+    }
+
+    g_string_erase(buf, prefix, oldLen - suffix - prefix);
+    g_string_insert_len(buf, prefix, newBuf + prefix, newLen - suffix - prefix);
+
+    g_array_remove_range(offsets, first, last - first);
+    guint i = first;
+
+    for (const gchar *cP = newBuf + prefix; cP < newBuf + newLen - suffix;
+         cP = g_utf8_next_char(cP), i++) {
+        gsize offset = cP - newBuf;
+
+        g_array_insert_val(offsets, i, offset);
+    }
+    for (; i < offsets->len; i++) {
+        g_array_index(offsets, gsize, i) = g_array_index(offsets, gsize, i) + newLen - oldLen;
+    }
+}
+
 void ibus_chewing_pre_edit_update(IBusChewingPreEdit *self) {
     IBUS_CHEWING_LOG(DEBUG, "* ibus_chewing_pre_edit_update(-)");
 
     /* Make preEdit */
-    gchar *bufferStr = chewing_buffer_String(self->context);
-    gchar *bpmfStr = ibus_chewing_pre_edit_get_bopomofo_string(self);
-
-    self->bpmfLen = (gint)g_utf8_strlen(bpmfStr, -1);
-
-    g_string_assign(self->preEdit, "");
-    gint i;
-    gchar *cP = bufferStr;
-    gunichar uniCh;
+    const gchar *bufferStr = chewing_buffer_String_static(self->context);
+    const gchar *bpmfStr = chewing_bopomofo_String_static(self->context);
+    gint cursor = cursor_current;
 
     IBUS_CHEWING_LOG(INFO,
                      "* ibus_chewing_pre_edit_update(-)  bufferStr=|%s|, "
-                     "bpmfStr=|%s| bpmfLen=%d cursor=%d",
-                     bufferStr, bpmfStr, self->bpmfLen, cursor_current);
+                     "bpmfStr=|%s| cursor=%d",
+                     bufferStr, bpmfStr, cursor);
 
-    for (i = 0; i < chewing_buffer_Len(self->context) && cP != NULL; i++) {
-        if (i == cursor_current) {
-            /* Insert bopomofo string */
-            g_string_append(self->preEdit, bpmfStr);
-        }
-        uniCh = g_utf8_get_char(cP);
-        g_string_append_unichar(self->preEdit, uniCh);
-        cP = g_utf8_next_char(cP);
-    }
-    if (chewing_buffer_Len(self->context) <= cursor_current) {
-        g_string_append(self->preEdit, bpmfStr);
-    }
+    /* Take the old bopomofo out, then patch the buffer */
+    g_string_erase(self->preEdit, self->bpmfOffset, self->bpmfBytes);
+    self_buffer_apply(self, bufferStr);
+
+    gint bufferLen = (gint)self->charOffsets->len - 1;
 
-    self->wordLen = i + self->bpmfLen;
+    /* Insert bopomofo string at cursor */
+    self->bpmfOffset = g_array_index(self->charOffsets, gsize, CLAMP(cursor, 0, bufferLen));
+    self->bpmfBytes = strlen(bpmfStr);
+    self->bpmfLen = (gint)g_utf8_strlen(bpmfStr, self->bpmfBytes);
+    g_string_insert_len(self->preEdit, self->bpmfOffset, bpmfStr, self->bpmfBytes);
 
-    chewing_free(bufferStr);
-    g_free(bpmfStr);
+    self->wordLen = bufferLen + self->bpmfLen;
 
     ibus_chewing_pre_edit_update_outgoing(self);
+    /* The key that may have committed is done */
+    g_ptr_array_set_size(self->learnSnapshot, 0);
 }
 
 guint ibus_chewing_pre_edit_length(IBusChewingPreEdit *self) { return self->preEdit->len; }
@@ -131,12 +430,8 @@ void ibus_chewing_pre_edit_clear(IBusChewingPreEdit *self) {
     ibus_chewing_pre_edit_clear_pre_edit(self);
 }
 
-void ibus_chewing_pre_edit_clear_bopomofo(IBusChewingPreEdit *self) {
-    IBUS_CHEWING_LOG(DEBUG, "ibus_chewing_pre_edit_clear_bopomofo(-)");
-
-    /* Esc key can close candidate list, clear bopomofo, and clear
-     * the whole pre-edit buffer. Make sure it acts as we expected.
-     */
+/* Close the candidate list and drop bopomofo with whatever Esc does now */
+static void self_clear_bopomofo(IBusChewingPreEdit *self) {
     if (table_is_showing) {
         chewing_handle_Esc(self->context);
     }
@@ -146,19 +441,25 @@ void ibus_chewing_pre_edit_clear_bopomofo(IBusChewingPreEdit *self) {
     }
 }
 
-void ibus_chewing_pre_edit_clear_pre_edit(IBusChewingPreEdit *self) {
-    IBUS_CHEWING_LOG(DEBUG, "ibus_chewing_pre_edit_clear_pre_edit(-)");
-
-    ibus_chewing_pre_edit_clear_bopomofo(self);
+void ibus_chewing_pre_edit_clear_bopomofo(IBusChewingPreEdit *self) {
+    IBUS_CHEWING_LOG(DEBUG, "ibus_chewing_pre_edit_clear_bopomofo(-)");
 
-    /* Save the orig Esc clean buffer state */
-    gint origState = chewing_get_escCleanAllBuf(self->context);
+    /* Esc key can close candidate list, clear bopomofo, and clear
+     * the whole pre-edit buffer. Make sure it acts as we expected.
+     */
+    self_apply_esc_clean_all_buf(self, self->config.escCleanAllBuf);
+    self_clear_bopomofo(self);
+}
 
-    chewing_set_escCleanAllBuf(self->context, TRUE);
+void ibus_chewing_pre_edit_clear_pre_edit(IBusChewingPreEdit *self) {
+    IBUS_CHEWING_LOG(DEBUG, "ibus_chewing_pre_edit_clear_pre_edit(-)");
 
+    /* Everything goes anyway, so Esc may clean the whole buffer throughout */
+    self_apply_esc_clean_all_buf(self, TRUE);
+    self_clear_bopomofo(self);
     chewing_handle_Esc(self->context);
+    self_apply_esc_clean_all_buf(self, self->config.escCleanAllBuf);
 
-    chewing_set_escCleanAllBuf(self->context, origState);
     ibus_chewing_pre_edit_update(self);
 }
 
@@ -183,6 +484,7 @@ void ibus_chewing_pre_edit_set_chi_eng_mode(IBusChewingPreEdit *self, gboolean c
         ibus_chewing_pre_edit_clear_bopomofo(self);
     }
     chewing_set_ChiEngMode(self->context, (chineseMode) ? 1 : 0);
+    update_pass_through(self);
 }
 
 void ibus_chewing_pre_edit_set_full_half_mode(IBusChewingPreEdit *self, gboolean fullShapeMode) {
@@ -191,6 +493,7 @@ void ibus_chewing_pre_edit_set_full_half_mode(IBusChewingPreEdit *self, gboolean
         ibus_chewing_pre_edit_clear_bopomofo(self);
     }
     chewing_set_ShapeMode(self->context, (fullShapeMode) ? 1 : 0);
+    update_pass_through(self);
 }
 
 /**************************************
@@ -198,12 +501,12 @@ void ibus_chewing_pre_edit_set_full_half_mode(IBusChewingPreEdit *self, gboolean
  */
 KSym self_key_sym_fix(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
     IBusChewingEngine *engine = IBUS_CHEWING_ENGINE(self->engine);
-    gchar caseConversionMode = ibus_chewing_engine_get_default_english_case(engine);
-    gchar toggleChinese = ibus_chewing_engine_get_chinese_english_toggle_key(engine);
+    EnglishCase caseConversionMode = ibus_chewing_engine_get_default_english_case(engine);
+    ChiEngToggle toggleChinese = ibus_chewing_engine_get_chinese_english_toggle_key(engine);
 
-    if (toggleChinese != 'c') {
+    if (toggleChinese != CHI_ENG_TOGGLE_CAPS_LOCK) {
 
-        caseConversionMode = 'n';
+        caseConversionMode = ENGLISH_CASE_NO_DEFAULT;
     }
     if (is_chinese) {
         /*
@@ -216,14 +519,14 @@ KSym self_key_sym_fix(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmasked
     } else {
         /* May need to change case if Caps Lock toggle chinese */
         switch (caseConversionMode) {
-        case 'l':
+        case ENGLISH_CASE_LOWERCASE:
             if (is_shift) {
                 /* Uppercase */
                 return toupper(kSym);
             }
             /* Lowercase */
             return tolower(kSym);
-        case 'u':
+        case ENGLISH_CASE_UPPERCASE:
             if (is_shift) {
                 /* Lowercase */
                 return tolower(kSym);
@@ -237,26 +540,50 @@ KSym self_key_sym_fix(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmasked
     return kSym;
 }
 
+/**
+ * self_cand_page_sync:
+ *
+ * Turn libchewing to the page that iTable shows.
+ * Paging through iTable is local, so libchewing only needs to follow
+ * before a key that may select a candidate.
+ */
+static void self_cand_page_sync(IBusChewingPreEdit *self) {
+    gint page = (gint)ibus_chewing_lookup_table_get_page(self->iTable);
+    gint totalPage = chewing_cand_TotalPage(self->context);
+
+    for (gint i = 0; i < totalPage && chewing_cand_CurrentPage(self->context) != page; i++) {
+        if (chewing_cand_CurrentPage(self->context) < page) {
+            chewing_call(chewing_handle_PageDown(self->context));
+        } else {
+            chewing_call(chewing_handle_PageUp(self->context));
+        }
+    }
+    self->candPage = chewing_cand_CurrentPage(self->context);
+}
+
 EventResponse self_handle_key_sym_default(IBusChewingPreEdit *self, KSym kSym,
                                           KeyModifiers unmaskedMod) {
     filter_modifiers(IBUS_SHIFT_MASK);
 
     handle_log("key_sym_default");
 
+    /* Selection keys pick from the page iTable shows */
+    if (table_is_showing) {
+        self_cand_page_sync(self);
+    }
+
     /* Seem like we need to disable easy symbol temporarily
-     * otherwise the key won't process
+     * otherwise the key won't process.
+     * Only chewing_handle_Default() looks at it, so it is not restored.
      */
-    gint easySymbolInput = chewing_get_easySymbolInput(self->context);
-
-    if (maskedMod != IBUS_SHIFT_MASK) {
-        chewing_set_easySymbolInput(self->context, 0);
-    }
+    self_apply_easy_symbol_input(self,
+                                 (maskedMod == IBUS_SHIFT_MASK) ? self->config.easySymbolInput : 0);
     EventResponse response = EVENT_RESPONSE_UNDECIDED;
     KSym fixedKSym = self_key_sym_fix(self, kSym, unmaskedMod);
 
     IBUS_CHEWING_LOG(DEBUG, "* self_handle_key_sym_default(): new kSym %x(%s), %x(%s)", fixedKSym,
                      key_sym_get_name(fixedKSym), unmaskedMod, modifiers_to_string(unmaskedMod));
-    gint ret = chewing_handle_Default(self->context, fixedKSym);
+    gint ret = chewing_call(chewing_handle_Default(self->context, fixedKSym));
 
     /* Handle quick commit */
     ibus_chewing_pre_edit_update_outgoing(self);
@@ -277,8 +604,6 @@ EventResponse self_handle_key_sym_default(IBusChewingPreEdit *self, KSym kSym,
     }
 
     IBUS_CHEWING_LOG(DEBUG, "self_handle_key_sym_default() ret=%d response=%d", ret, response);
-    /* Restore easySymbolInput */
-    chewing_set_easySymbolInput(self->context, easySymbolInput);
     return response;
 }
 
@@ -295,7 +620,7 @@ EventResponse self_handle_num(IBusChewingPreEdit *self, KSym kSym, KeyModifiers
     handle_log("num");
 
     if (is_ctrl_only) {
-        return event_process_or_ignore(!chewing_handle_CtrlNum(self->context, kSym));
+        return event_process_or_ignore(!chewing_call(chewing_handle_CtrlNum(self->context, kSym)));
     }
     /* maskedMod = 0 */
     return self_handle_key_sym_default(self, kSym, unmaskedMod);
@@ -320,18 +645,24 @@ EventResponse self_handle_num_keypad(IBusChewingPreEdit *self, KSym kSym,
     }
 
     if (is_ctrl_only) {
-        return event_process_or_ignore(!chewing_handle_CtrlNum(self->context, kSymEquiv));
+        return event_process_or_ignore(
+            !chewing_call(chewing_handle_CtrlNum(self->context, kSymEquiv)));
     }
 
     /* maskedMod = 0 */
-    /* switch to eng-mode temporary */
-    gint origChiEngMode = chewing_get_ChiEngMode(self->context);
+    /* switch to eng-mode temporary, libchewing changes the mode itself so
+     * it is not mirrored */
+    gboolean chineseMode = is_chinese;
 
-    ibus_chewing_pre_edit_set_chi_eng_mode(self, FALSE);
+    if (chineseMode) {
+        ibus_chewing_pre_edit_set_chi_eng_mode(self, FALSE);
+    }
 
     EventResponse response = self_handle_key_sym_default(self, kSymEquiv, unmaskedMod);
 
-    chewing_set_ChiEngMode(self->context, origChiEngMode);
+    if (chineseMode) {
+        chewing_set_ChiEngMode(self->context, CHINESE_MODE);
+    }
 
     return response;
 }
@@ -340,9 +671,9 @@ EventResponse self_handle_caps_lock(IBusChewingPreEdit *self, KSym kSym, KeyModi
     filter_modifiers(IBUS_LOCK_MASK);
 
     IBusChewingEngine *engine = IBUS_CHEWING_ENGINE(self->engine);
-    gchar toggleChinese = ibus_chewing_engine_get_chinese_english_toggle_key(engine);
+    ChiEngToggle toggleChinese = ibus_chewing_engine_get_chinese_english_toggle_key(engine);
 
-    if (toggleChinese != 'c') {
+    if (toggleChinese != CHI_ENG_TOGGLE_CAPS_LOCK) {
         /* Ignore the Caps Lock event when it does not toggle Chinese */
         return EVENT_RESPONSE_IGNORE;
     }
@@ -355,7 +686,7 @@ EventResponse self_handle_caps_lock(IBusChewingPreEdit *self, KSym kSym, KeyModi
         ibus_chewing_pre_edit_clear_bopomofo(self);
     }
 
-    return event_process_or_ignore(!chewing_handle_Capslock(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_Capslock(self->context)));
 }
 
 EventResponse self_handle_shift_left(IBusChewingPreEdit *self, KSym kSym,
@@ -364,9 +695,9 @@ EventResponse self_handle_shift_left(IBusChewingPreEdit *self, KSym kSym,
     handle_log("shift_left");
 
     IBusChewingEngine *engine = IBUS_CHEWING_ENGINE(self->engine);
-    gchar toggleChinese = ibus_chewing_engine_get_chinese_english_toggle_key(engine);
+    ChiEngToggle toggleChinese = ibus_chewing_engine_get_chinese_english_toggle_key(engine);
 
-    if (toggleChinese != 's' && toggleChinese != 'l') {
+    if (toggleChinese != CHI_ENG_TOGGLE_SHIFT && toggleChinese != CHI_ENG_TOGGLE_SHIFT_L) {
         return EVENT_RESPONSE_IGNORE;
     }
 
@@ -392,9 +723,9 @@ EventResponse self_handle_shift_right(IBusChewingPreEdit *self, KSym kSym,
     handle_log("shift_right");
 
     IBusChewingEngine *engine = IBUS_CHEWING_ENGINE(self->engine);
-    gchar toggleChinese = ibus_chewing_engine_get_chinese_english_toggle_key(engine);
+    ChiEngToggle toggleChinese = ibus_chewing_engine_get_chinese_english_toggle_key(engine);
 
-    if (toggleChinese != 's' && toggleChinese != 'r') {
+    if (toggleChinese != CHI_ENG_TOGGLE_SHIFT && toggleChinese != CHI_ENG_TOGGLE_SHIFT_R) {
         return EVENT_RESPONSE_IGNORE;
     }
 
@@ -420,17 +751,24 @@ EventResponse self_handle_page_up(IBusChewingPreEdit *self, KSym kSym, KeyModifi
     ignore_when_release;
     handle_log("page_up");
 
-    int currentPage = chewing_cand_CurrentPage(self->context);
-    int hasNext = chewing_cand_list_has_next(self->context);
-    int hasPrev = chewing_cand_list_has_prev(self->context);
+    if (table_is_showing) {
+        guint page = ibus_chewing_lookup_table_get_page(self->iTable);
 
-    if (table_is_showing && (currentPage == 0)) {
-        if (hasNext == 1 || hasPrev == 1) {
-            return event_process_or_ignore(!chewing_handle_Down(self->context));
+        /* iTable holds the whole list, so paging within it stays local */
+        if (page > 0) {
+            ibus_chewing_lookup_table_set_page(self->iTable, page - 1);
+            return EVENT_RESPONSE_ABSORB;
         }
+        if (chewing_cand_list_has_next(self->context) == 1 ||
+            chewing_cand_list_has_prev(self->context) == 1) {
+            return event_process_or_ignore(!chewing_call(chewing_handle_Down(self->context)));
+        }
+        /* Wrap around to the last page, as libchewing does */
+        ibus_chewing_lookup_table_set_page(self->iTable, G_MAXUINT);
+        return EVENT_RESPONSE_ABSORB;
     }
 
-    return event_process_or_ignore(!chewing_handle_PageUp(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_PageUp(self->context)));
 }
 
 EventResponse self_handle_page_down(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -439,14 +777,17 @@ EventResponse self_handle_page_down(IBusChewingPreEdit *self, KSym kSym, KeyModi
     ignore_when_release;
     handle_log("page_down");
 
-    int totalPage = chewing_cand_TotalPage(self->context);
-    int currentPage = chewing_cand_CurrentPage(self->context);
+    if (table_is_showing) {
+        guint page = ibus_chewing_lookup_table_get_page(self->iTable);
 
-    if (table_is_showing && (currentPage == totalPage - 1)) {
-        return event_process_or_ignore(!chewing_handle_Down(self->context));
+        if (page + 1 < ibus_chewing_lookup_table_get_total_pages(self->iTable)) {
+            ibus_chewing_lookup_table_set_page(self->iTable, page + 1);
+            return EVENT_RESPONSE_ABSORB;
+        }
+        return event_process_or_ignore(!chewing_call(chewing_handle_Down(self->context)));
     }
 
-    return event_process_or_ignore(!chewing_handle_PageDown(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_PageDown(self->context)));
 }
 
 EventResponse self_handle_space(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -462,14 +803,19 @@ EventResponse self_handle_space(IBusChewingPreEdit *self, KSym kSym, KeyModifier
     ignore_when_release;
     handle_log("space");
 
+    /* Space turns or selects from the page iTable shows */
+    if (table_is_showing) {
+        self_cand_page_sync(self);
+    }
+
     if (is_shift_only) {
         handle_log("Shift+Space");
-        chewing_handle_ShiftSpace(self->context);
+        chewing_call(chewing_handle_ShiftSpace(self->context));
         ibus_chewing_engine_notify_fullwidth_mode_change(IBUS_CHEWING_ENGINE(self->engine));
         return EVENT_RESPONSE_PROCESS;
     }
 
-    return event_process_or_ignore(!chewing_handle_Space(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_Space(self->context)));
 }
 
 EventResponse self_handle_return(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -481,11 +827,12 @@ EventResponse self_handle_return(IBusChewingPreEdit *self, KSym kSym, KeyModifie
     if (table_is_showing) {
         int cursorInPage = ibus_lookup_table_get_cursor_in_page(self->iTable);
 
-        cursorInPage = chewing_get_selKey(self->context)[cursorInPage];
+        cursorInPage = self->selKeys[cursorInPage];
         return self_handle_key_sym_default(self, cursorInPage, unmaskedMod);
     }
 
-    EventResponse response = event_process_or_ignore(!chewing_handle_Enter(self->context));
+    EventResponse response =
+        event_process_or_ignore(!chewing_call(chewing_handle_Enter(self->context)));
 
     /* Handle quick commit */
     ibus_chewing_pre_edit_update_outgoing(self);
@@ -500,7 +847,7 @@ EventResponse self_handle_backspace(IBusChewingPreEdit *self, KSym kSym, KeyModi
     // absorb.
     handle_log("backspace");
 
-    return event_process_or_ignore(!chewing_handle_Backspace(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_Backspace(self->context)));
 }
 
 EventResponse self_handle_delete(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -509,7 +856,7 @@ EventResponse self_handle_delete(IBusChewingPreEdit *self, KSym kSym, KeyModifie
     ignore_when_release;
     handle_log("delete");
 
-    return event_process_or_ignore(!chewing_handle_Del(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_Del(self->context)));
 }
 
 EventResponse self_handle_escape(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -518,7 +865,8 @@ EventResponse self_handle_escape(IBusChewingPreEdit *self, KSym kSym, KeyModifie
     ignore_when_release;
     handle_log("escape");
 
-    return event_process_or_ignore(!chewing_handle_Esc(self->context));
+    self_apply_esc_clean_all_buf(self, self->config.escCleanAllBuf);
+    return event_process_or_ignore(!chewing_call(chewing_handle_Esc(self->context)));
 }
 
 EventResponse self_handle_left(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -528,7 +876,7 @@ EventResponse self_handle_left(IBusChewingPreEdit *self, KSym kSym, KeyModifiers
     handle_log("left");
 
     if (is_shift_only) {
-        return event_process_or_ignore(!chewing_handle_ShiftLeft(self->context));
+        return event_process_or_ignore(!chewing_call(chewing_handle_ShiftLeft(self->context)));
     }
 
     if (table_is_showing) {
@@ -546,7 +894,7 @@ EventResponse self_handle_left(IBusChewingPreEdit *self, KSym kSym, KeyModifiers
         return self_handle_page_up(self, kSym, unmaskedMod);
     }
 
-    return event_process_or_ignore(!chewing_handle_Left(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_Left(self->context)));
 }
 
 EventResponse self_handle_up(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -570,7 +918,7 @@ EventResponse self_handle_up(IBusChewingPreEdit *self, KSym kSym, KeyModifiers u
         return self_handle_page_up(self, kSym, unmaskedMod);
     }
 
-    return event_process_or_ignore(!chewing_handle_Up(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_Up(self->context)));
 }
 
 EventResponse self_handle_right(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -580,14 +928,14 @@ EventResponse self_handle_right(IBusChewingPreEdit *self, KSym kSym, KeyModifier
     handle_log("right");
 
     if (is_shift_only) {
-        return event_process_or_ignore(!chewing_handle_ShiftRight(self->context));
+        return event_process_or_ignore(!chewing_call(chewing_handle_ShiftRight(self->context)));
     }
 
     if (table_is_showing) {
         IBusChewingEngine *engine = IBUS_CHEWING_ENGINE(self->engine);
         if (!ibus_chewing_engine_use_vertical_lookup_table(engine)) {
             /* horizontal look-up table */
-            int numberCand = ibus_lookup_table_get_number_of_candidates(self->iTable);
+            int numberCand = ibus_chewing_lookup_table_get_page_length(self->iTable);
             int cursorInPage = ibus_lookup_table_get_cursor_in_page(self->iTable) + 1;
             if (cursorInPage != numberCand) {
                 ibus_lookup_table_cursor_down(self->iTable);
@@ -598,7 +946,7 @@ EventResponse self_handle_right(IBusChewingPreEdit *self, KSym kSym, KeyModifier
         return self_handle_page_down(self, kSym, unmaskedMod);
     }
 
-    return event_process_or_ignore(!chewing_handle_Right(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_Right(self->context)));
 }
 
 EventResponse self_handle_down(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -611,7 +959,7 @@ EventResponse self_handle_down(IBusChewingPreEdit *self, KSym kSym, KeyModifiers
         IBusChewingEngine *engine = IBUS_CHEWING_ENGINE(self->engine);
         if (!ibus_chewing_engine_use_vertical_lookup_table(engine)) {
             /* vertical look-up table */
-            int numberCand = ibus_lookup_table_get_number_of_candidates(self->iTable);
+            int numberCand = ibus_chewing_lookup_table_get_page_length(self->iTable);
             int cursorInPage = ibus_lookup_table_get_cursor_in_page(self->iTable) + 1;
             if (cursorInPage != numberCand) {
                 ibus_lookup_table_cursor_down(self->iTable);
@@ -623,7 +971,7 @@ EventResponse self_handle_down(IBusChewingPreEdit *self, KSym kSym, KeyModifiers
         return self_handle_page_down(self, kSym, unmaskedMod);
     }
 
-    return event_process_or_ignore(!chewing_handle_Down(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_Down(self->context)));
 }
 
 EventResponse self_handle_tab(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -632,7 +980,7 @@ EventResponse self_handle_tab(IBusChewingPreEdit *self, KSym kSym, KeyModifiers
     ignore_when_release;
     handle_log("tab");
 
-    return event_process_or_ignore(!chewing_handle_Tab(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_Tab(self->context)));
 }
 
 EventResponse self_handle_home(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -641,7 +989,7 @@ EventResponse self_handle_home(IBusChewingPreEdit *self, KSym kSym, KeyModifiers
     ignore_when_release;
     handle_log("home");
 
-    return event_process_or_ignore(!chewing_handle_Home(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_Home(self->context)));
 }
 
 EventResponse self_handle_end(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
@@ -650,7 +998,7 @@ EventResponse self_handle_end(IBusChewingPreEdit *self, KSym kSym, KeyModifiers
     ignore_when_release;
     handle_log("end");
 
-    return event_process_or_ignore(!chewing_handle_End(self->context));
+    return event_process_or_ignore(!chewing_call(chewing_handle_End(self->context)));
 }
 
 EventResponse self_handle_special([[maybe_unused]] IBusChewingPreEdit *self,
@@ -737,7 +1085,7 @@ KeyHandlingRule keyHandlingRules[] = {
     {0, G_MAXUINT, self_handle_special},
 };
 
-static KeyHandlingRule *self_key_sym_find_key_handling_rule(KSym kSym) {
+KeyHandlingRule *self_key_sym_find_key_handling_rule_linear(KSym kSym) {
     gint i;
 
     for (i = 0; keyHandlingRules[i].kSymLower != 0; i++) {
@@ -748,6 +1096,42 @@ static KeyHandlingRule *self_key_sym_find_key_handling_rule(KSym kSym) {
     return &(keyHandlingRules[i]);
 }
 
+/*
+ * Every rule except the catch-all one lies either in Latin-1 (0x00~0xff)
+ * or in the function key block (0xff00~0xffff), so key - base is a perfect
+ * hash for both blocks. The tables are filled from keyHandlingRules,
+ * which stays the single source of truth.
+ */
+#define KEY_DISPATCH_TABLE_SIZE 256
+#define KEY_DISPATCH_FUNCTION_BASE 0xff00
+
+static KeyHandlingRule *keyDispatchLatin1[KEY_DISPATCH_TABLE_SIZE];
+static KeyHandlingRule *keyDispatchFunction[KEY_DISPATCH_TABLE_SIZE];
+#define keyHandlingRuleSpecial (&keyHandlingRules[G_N_ELEMENTS(keyHandlingRules) - 1])
+
+static void self_key_dispatch_init() {
+    static gsize initialized = 0;
+
+    if (g_once_init_enter(&initialized)) {
+        for (KSym i = 0; i < KEY_DISPATCH_TABLE_SIZE; i++) {
+            keyDispatchLatin1[i] = self_key_sym_find_key_handling_rule_linear(i);
+            keyDispatchFunction[i] =
+                self_key_sym_find_key_handling_rule_linear(KEY_DISPATCH_FUNCTION_BASE + i);
+        }
+        g_once_init_leave(&initialized, 1);
+    }
+}
+
+KeyHandlingRule *self_key_sym_find_key_handling_rule(KSym kSym) {
+    if (kSym < KEY_DISPATCH_TABLE_SIZE) {
+        return keyDispatchLatin1[kSym];
+    }
+    if (kSym - KEY_DISPATCH_FUNCTION_BASE < KEY_DISPATCH_TABLE_SIZE) {
+        return keyDispatchFunction[kSym - KEY_DISPATCH_FUNCTION_BASE];
+    }
+    return keyHandlingRuleSpecial;
+}
+
 #define handle_key(kSym, unmaskedMod)                                                              \
     (self_key_sym_find_key_handling_rule(kSym))->keyFunc(self, kSym, unmaskedMod)
 
@@ -771,8 +1155,7 @@ gboolean is_shift_toggle(KSym keyLast, KSym kSym, KeyModifiers unmaskedMod) {
 }
 
 /* keyCode should be converted to kSym already */
-gboolean ibus_chewing_pre_edit_process_key(IBusChewingPreEdit *self, KSym kSym,
-                                           KeyModifiers unmaskedMod) {
+static gboolean process_key(IBusChewingPreEdit *self, KSym kSym, KeyModifiers unmaskedMod) {
     IBUS_CHEWING_LOG(INFO, "***** ibus_chewing_pre_edit_process_key(-,%x(%s),%x(%s))", kSym,
                      key_sym_get_name(kSym), unmaskedMod, modifiers_to_string(unmaskedMod));
     process_key_debug("Before response");
@@ -794,7 +1177,13 @@ gboolean ibus_chewing_pre_edit_process_key(IBusChewingPreEdit *self, KSym kSym,
         };
     }
 
+    /* Any key may commit, e.g. a full buffer makes room, Enter, a quick commit */
+    if (!(unmaskedMod & IBUS_RELEASE_MASK)) {
+        self_learn_snapshot(self);
+    }
+    IBUS_CHEWING_TRACE(handle_entry, kSym, unmaskedMod);
     response = handle_key(kSym, unmaskedMod);
+    IBUS_CHEWING_TRACE(handle_return, response);
 
     IBUS_CHEWING_LOG(DEBUG, "ibus_chewing_pre_edit_process_key() response=%x", response);
     process_key_debug("After response");
@@ -808,9 +1197,36 @@ gboolean ibus_chewing_pre_edit_process_key(IBusChewingPreEdit *self, KSym kSym,
         break;
     }
 
+    IBUS_CHEWING_TRACE(preedit_update_entry);
     ibus_chewing_pre_edit_update(self);
+    IBUS_CHEWING_TRACE(preedit_update_return, self->wordLen);
 
-    guint candidateCount = ibus_chewing_lookup_table_update(self->iTable, self->context);
+    gboolean tableChanged = FALSE;
+    guint candidateCount = 0;
+
+    /* Most keys neither show nor hide a table, then the empty table is current already */
+    if (table_is_showing || chewing_cand_TotalChoice(self->context) > 0) {
+        IBUS_CHEWING_TRACE(table_update_entry);
+        candidateCount =
+            ibus_chewing_lookup_table_update(self->iTable, self->context, &tableChanged);
+        IBUS_CHEWING_TRACE(table_update_return, candidateCount);
+    }
+
+    if (tableChanged) {
+        self->tableGeneration++;
+    }
+
+    gint chewingPage = chewing_cand_CurrentPage(self->context);
+
+    if (tableChanged || chewingPage != self->candPage) {
+        /* A new list, or libchewing turned the page itself */
+        self->candPage = chewingPage;
+        ibus_chewing_lookup_table_set_page(self->iTable, chewingPage);
+    } else {
+        /* Back to the first candidate of the page, as for a new list */
+        ibus_chewing_lookup_table_set_page(self->iTable,
+                                           ibus_chewing_lookup_table_get_page(self->iTable));
+    }
 
     IBUS_CHEWING_LOG(INFO, "ibus_chewing_pre_edit_process_key() candidateCount=%d", candidateCount);
 
@@ -822,6 +1238,103 @@ gboolean ibus_chewing_pre_edit_process_key(IBusChewingPreEdit *self, KSym kSym,
     return TRUE;
 }
 
+/* The same test as the English sub-mode shortcut in process_key(), minus the key */
+static void update_pass_through(IBusChewingPreEdit *self) {
+    self->passThrough = !is_full_shape && !is_chinese && ibus_chewing_pre_edit_length(self) == 0 &&
+                        !ibus_chewing_pre_edit_has_flag(self, FLAG_TABLE_SHOW);
+}
+
+gboolean ibus_chewing_pre_edit_process_key(IBusChewingPreEdit *self, KSym kSym,
+                                           KeyModifiers unmaskedMod) {
+    gboolean result = process_key(self, kSym, unmaskedMod);
+
+    update_pass_through(self);
+    return result;
+}
+
+gboolean ibus_chewing_pre_edit_pass_through(IBusChewingPreEdit *self, KSym kSym,
+                                            KeyModifiers unmaskedMod) {
+    if (!self->passThrough || kSym == IBUS_KEY_Caps_Lock ||
+        (kSym == IBUS_KEY_space && unmaskedMod == IBUS_SHIFT_MASK) ||
+        is_shift_toggle(self->keyLast, kSym, unmaskedMod)) {
+        return FALSE;
+    }
+    self->keyLast = kSym;
+    return TRUE;
+}
+
+EventResponse ibus_chewing_pre_edit_process_release(IBusChewingPreEdit *self, KSym kSym,
+                                                    KeyModifiers unmaskedMod) {
+    IBusChewingEngine *engine = IBUS_CHEWING_ENGINE(self->engine);
+    ChiEngToggle toggleChinese = ibus_chewing_engine_get_chinese_english_toggle_key(engine);
+    KeyModifiers maskedMod = modifiers_mask(unmaskedMod);
+    EventResponse response = EVENT_RESPONSE_IGNORE;
+
+    /* Same outcomes as the release branches of the self_handle_* handlers */
+    switch (kSym) {
+    case IBUS_KEY_Shift_L:
+    case IBUS_KEY_Shift_R:
+        if (is_shift_key(self->keyLast) &&
+            (toggleChinese == CHI_ENG_TOGGLE_SHIFT ||
+             toggleChinese == ((kSym == IBUS_KEY_Shift_L) ? CHI_ENG_TOGGLE_SHIFT_L
+                                                          : CHI_ENG_TOGGLE_SHIFT_R))) {
+            /* Releasing a lone Shift toggles Chinese mode */
+            return EVENT_RESPONSE_UNDECIDED;
+        }
+        break;
+    case IBUS_KEY_Caps_Lock:
+        if (maskedMod == 0 && toggleChinese == CHI_ENG_TOGGLE_CAPS_LOCK) {
+            response = EVENT_RESPONSE_ABSORB;
+        }
+        break;
+    case IBUS_KEY_BackSpace:
+        if (maskedMod == 0 && !(buffer_is_empty && !table_is_showing)) {
+            response = EVENT_RESPONSE_ABSORB;
+        }
+        break;
+    default:
+        break;
+    }
+    self->keyLast = kSym;
+    return response;
+}
+
+void ibus_chewing_pre_edit_set_keymap(IBusChewingPreEdit *self, IBusKeymap *keymap) {
+    if (self->keymap == keymap) {
+        return;
+    }
+    if (keymap != NULL) {
+        g_object_ref(keymap);
+    }
+    g_clear_object(&self->keymap);
+    self->keymap = keymap;
+    g_clear_pointer(&self->keySymTable, g_free);
+}
+
+/*
+ * ibus_keymap_lookup_keysym() only looks at Shift, Lock, Mod2 (NumLock)
+ * and Mod5 (AltGr), so the key sym table has 16 states per key code.
+ */
+#define KEY_SYM_TABLE_KEY_CODES 256
+#define KEY_SYM_TABLE_STATES 16
+#define key_sym_table_state(mod)                                                                   \
+    (((mod) & (IBUS_SHIFT_MASK | IBUS_LOCK_MASK)) | (((mod) & IBUS_MOD2_MASK) >> 2) |              \
+     (((mod) & IBUS_MOD5_MASK) >> 4))
+
+static void self_key_sym_table_build(IBusChewingPreEdit *self) {
+    self->keySymTable = g_new(KSym, KEY_SYM_TABLE_KEY_CODES * KEY_SYM_TABLE_STATES);
+
+    for (guint state = 0; state < KEY_SYM_TABLE_STATES; state++) {
+        KeyModifiers mod = (state & (IBUS_SHIFT_MASK | IBUS_LOCK_MASK)) | ((state & 0x4) << 2) |
+                           ((state & 0x8) << 4);
+
+        for (guint keyCode = 0; keyCode < KEY_SYM_TABLE_KEY_CODES; keyCode++) {
+            self->keySymTable[keyCode * KEY_SYM_TABLE_STATES + state] =
+                ibus_keymap_lookup_keysym(self->keymap, keyCode, mod);
+        }
+    }
+}
+
 KSym ibus_chewing_pre_edit_key_code_to_key_sym(IBusChewingPreEdit *self, KSym keySym, guint keyCode,
                                                KeyModifiers unmaskedMod) {
     KSym kSym = keySym;
@@ -831,12 +1344,12 @@ KSym ibus_chewing_pre_edit_key_code_to_key_sym(IBusChewingPreEdit *self, KSym ke
         return kSym;
     }
 
-    IBusChewingEngine *engine = IBUS_CHEWING_ENGINE(self->engine);
-    if (!ibus_chewing_engine_use_system_layout(engine)) {
-        /* Use en_US keyboard layout */
-        /* ibus_keymap_lookup_key_sym treats keycode >= 256 */
-        /* as IBUS_VoidSymbol */
-        kSym = ibus_keymap_lookup_keysym(ibus_keymap_get("us"), keyCode, unmaskedMod);
+    if (self->keymap != NULL && keyCode < KEY_SYM_TABLE_KEY_CODES) {
+        /* Translate with the configured layout, usually en_US */
+        if (G_UNLIKELY(self->keySymTable == NULL)) {
+            self_key_sym_table_build(self);
+        }
+        kSym = self->keySymTable[keyCode * KEY_SYM_TABLE_STATES + key_sym_table_state(unmaskedMod)];
         if (kSym == IBUS_VoidSymbol) {
             /* Restore key_sym */
             kSym = keySym;
@@ -47,6 +47,9 @@
 #define IBUS_CHEWING_MAX_WORD 100
 #endif
 #define IBUS_CHEWING_MAX_BYTES UTF8_MAX_BYTES *IBUS_CHEWING_MAX_WORD
+#ifndef IBUS_CHEWING_LEARN_QUEUE_MAX
+#define IBUS_CHEWING_LEARN_QUEUE_MAX 128
+#endif
 
 /**
  * IBusChewingPreEditFlag:
@@ -60,6 +63,18 @@ typedef enum {
     FLAG_TABLE_SHOW = 1 << 2,
 } IBusChewingPreEditFlag;
 
+/**
+ * IBusChewingPreEditConfig:
+ * @easySymbolInput: Easy symbol input.
+ * @escCleanAllBuf:  Esc cleans the whole buffer.
+ *
+ * libchewing options that some keys need changed while handled.
+ */
+typedef struct {
+    gint easySymbolInput;
+    gint escCleanAllBuf;
+} IBusChewingPreEditConfig;
+
 /**
  * IBusChewingPreEdit:
  * @context:   chewing input context.
@@ -70,6 +85,31 @@ typedef enum {
  * @keyLast:   Last effective key.
  * @bpmfLen:   Length of bopomofo chars in unicode characters.
  * @wordLen:   Length of preEdit in unicode characters.
+ * @charOffsets: Byte offset in preEdit of each character of the chewing
+ *             buffer (bopomofo excluded), followed by the buffer byte length.
+ * @bpmfOffset: Byte offset of the bopomofo string in preEdit.
+ * @bpmfBytes: Length of the bopomofo string in bytes.
+ * @tableGeneration: Incremented whenever the candidates in iTable change.
+ * @candPage:  Candidate page libchewing is on. iTable holds the whole list
+ *             and pages through it locally, so libchewing only follows
+ *             when a candidate may be selected.
+ * @passThrough: English half-width mode with nothing to edit, so keys go to
+ *             the client untouched. Recomputed after each processed key and
+ *             mode change; see ibus_chewing_pre_edit_pass_through().
+ * @keymap:    Layout that key codes are translated with,
+ *             NULL to keep the key syms of the system layout.
+ * @keySymTable: Key sym of each key code and modifier state in @keymap,
+ *             built on first use.
+ * @deferLearning: libchewing auto-learning is off; committed phrases are
+ *             queued and learned by ibus_chewing_pre_edit_learn_flush().
+ * @learnSnapshot: Phrases of the buffer taken before each key, any may commit.
+ * @learnQueue: Committed phrases not yet learned.
+ * @config:    Options as the user set them.
+ * @applied:   Options as libchewing has them. They are changed right before
+ *             the libchewing call that needs another value, and only if it
+ *             differs, instead of being restored after every key.
+ * @selKeys:   Mirror of chewing_get_selKey(),
+ *             see ibus_chewing_pre_edit_sync_sel_keys().
  *
  * An IBusChewingPreEdit.
  */
@@ -80,14 +120,36 @@ typedef struct {
     GString *preEdit;
     GString *outgoing;
     IBusKeymap *keymap;
+    KSym *keySymTable;
     IBusLookupTable *iTable;
     IBusChewingPreEditFlag flags;
     KSym keyLast;
     gint bpmfLen;
     gint wordLen;
+    GArray *charOffsets;
+    gsize bpmfOffset;
+    gsize bpmfBytes;
+    guint tableGeneration;
+    gint candPage;
+    gboolean passThrough;
+    gboolean deferLearning;
+    GPtrArray *learnSnapshot;
+    GPtrArray *learnQueue;
+    IBusChewingPreEditConfig config;
+    IBusChewingPreEditConfig applied;
+    gint selKeys[MAX_SELKEY];
     IBusEngine *engine;
 } IBusChewingPreEdit;
 
+/**
+ * ibus_chewing_pre_edit_warm_up:
+ *
+ * Start building a chewing context in a thread, which loads the
+ * dictionary and opens the user phrase database.
+ * The next ibus_chewing_pre_edit_new() takes it instead of building its own.
+ */
+void ibus_chewing_pre_edit_warm_up();
+
 IBusChewingPreEdit *ibus_chewing_pre_edit_new();
 
 void ibus_chewing_pre_edit_free(IBusChewingPreEdit *self);
@@ -155,6 +217,29 @@ void ibus_chewing_pre_edit_set_full_half_mode(IBusChewingPreEdit *self,
 gboolean ibus_chewing_pre_edit_process_key(IBusChewingPreEdit *self, KSym kSym,
                                            KeyModifiers unmaskedMod);
 
+/**
+ * ibus_chewing_pre_edit_pass_through:
+ * @self: An IBusChewingPreEdit.
+ * @kSym: Key sym, untranslated is fine as modifier keys and space keep theirs.
+ * @unmaskedMod: Modifiers of the key event.
+ * @returns: TRUE if the key should go to the client without being processed.
+ *
+ * Decide without calling libchewing whether
+ * ibus_chewing_pre_edit_process_key() would just ignore the key,
+ * and track it as the last key if so.
+ */
+gboolean ibus_chewing_pre_edit_pass_through(IBusChewingPreEdit *self, KSym kSym,
+                                            KeyModifiers unmaskedMod);
+
+/**
+ * ibus_chewing_pre_edit_set_keymap:
+ * @self: An IBusChewingPreEdit.
+ * @keymap: Layout to translate key codes with, or NULL to use the system layout.
+ *
+ * Set the layout used by ibus_chewing_pre_edit_key_code_to_key_sym().
+ */
+void ibus_chewing_pre_edit_set_keymap(IBusChewingPreEdit *self, IBusKeymap *keymap);
+
 /**
  * ibus_chewing_pre_edit_key_code_to_key_sym:
  *
@@ -164,6 +249,44 @@ KSym ibus_chewing_pre_edit_key_code_to_key_sym(IBusChewingPreEdit *self,
                                                KSym keySym, guint keyCode,
                                                KeyModifiers unmaskedMod);
 
+void ibus_chewing_pre_edit_set_easy_symbol_input(IBusChewingPreEdit *self,
+                                                 gboolean easySymbolInput);
+void ibus_chewing_pre_edit_set_esc_clean_all_buf(IBusChewingPreEdit *self,
+                                                 gboolean escCleanAllBuf);
+
+/**
+ * ibus_chewing_pre_edit_sync_sel_keys:
+ * @self: An IBusChewingPreEdit.
+ *
+ * Refresh @selKeys after the selection keys of libchewing were set.
+ */
+void ibus_chewing_pre_edit_sync_sel_keys(IBusChewingPreEdit *self);
+
+/**
+ * ibus_chewing_pre_edit_set_defer_learning:
+ * @self: An IBusChewingPreEdit.
+ * @deferLearning: TRUE to queue committed phrases instead of letting
+ *             libchewing learn them on commit.
+ *
+ * Turning deferred learning off learns the queued phrases first.
+ */
+void ibus_chewing_pre_edit_set_defer_learning(IBusChewingPreEdit *self, gboolean deferLearning);
+
+/**
+ * ibus_chewing_pre_edit_learn_flush:
+ * @self: An IBusChewingPreEdit.
+ * @returns: Number of phrases learned.
+ *
+ * Add the queued phrases to the user phrase store in one pass.
+ */
+guint ibus_chewing_pre_edit_learn_flush(IBusChewingPreEdit *self);
+
+#define ibus_chewing_pre_edit_learn_pending(self) (self->learnQueue->len)
+
+/* The queue holds IBUS_CHEWING_LEARN_QUEUE_MAX phrases, the next commit drops the oldest */
+#define ibus_chewing_pre_edit_learn_is_full(self)                              \
+    (self->learnQueue->len >= IBUS_CHEWING_LEARN_QUEUE_MAX)
+
 /**
  * ibus_chewing_bopomofo_check(ChewingContext *context)
  * @returns: 1 if bopomofo buffer is non-empty; 0 if bopomofo buffer is empty.
@@ -180,6 +303,21 @@ typedef enum {
     EVENT_RESPONSE_UNDECIDED,
 } EventResponse;
 
+/**
+ * ibus_chewing_pre_edit_process_release:
+ * @self: An IBusChewingPreEdit.
+ * @kSym: Key sym of a release event, untranslated is fine.
+ * @unmaskedMod: Modifiers of the key event, including IBUS_RELEASE_MASK.
+ * @returns: EVENT_RESPONSE_ABSORB or EVENT_RESPONSE_IGNORE,
+ *           or EVENT_RESPONSE_UNDECIDED if the release toggles Chinese mode
+ *           and needs ibus_chewing_pre_edit_process_key().
+ *
+ * Answer a key release without libchewing, tracking it as the last key.
+ * Nothing but the Shift toggle changes state on release.
+ */
+EventResponse ibus_chewing_pre_edit_process_release(IBusChewingPreEdit *self, KSym kSym,
+                                                    KeyModifiers unmaskedMod);
+
 typedef EventResponse (*KeyHandlingFunc)(IBusChewingPreEdit *self, KSym kSym,
                                          KeyModifiers unmaskedMod);
 
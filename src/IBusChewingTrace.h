@@ -0,0 +1,39 @@
+/**
+ * SECTION:IBusChewingTrace
+ * @short_description: Static tracepoints of the key pipeline
+ * @title: IBusChewingTrace
+ * @stability: Unstable
+ * @include: IBusChewingTrace.h
+ *
+ * USDT probes under the provider <emphasis>ibus_chewing</emphasis>.
+ * They are NOPs until a tracer such as bpftrace or perf attaches,
+ * and compile to nothing when sys/sdt.h is not available.
+ *
+ * Every stage has a <emphasis>_entry</emphasis> and a
+ * <emphasis>_return</emphasis> probe on the same thread:
+ *
+ * - key: ibus_chewing_engine_process_key_event(), args keySym, keyCode,
+ *   modifiers; returns the result.
+ * - keysym: key code to key sym translation; returns kSym.
+ * - handle: the self_handle_* key handler, args kSym, modifiers; returns the
+ *   EventResponse. The <emphasis>handler</emphasis> probe fires in between
+ *   with the handler name.
+ * - chewing: a chewing_handle_* call; returns its result.
+ * - preedit_update: ibus_chewing_pre_edit_update(); returns wordLen.
+ * - table_update: ibus_chewing_lookup_table_update(); returns the
+ *   candidate count.
+ * - ui: a D-Bus emission to IBus, arg is its name.
+ *
+ * See data/ibus-chewing-stages.bt for an example.
+ */
+
+#pragma once
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define IBUS_CHEWING_TRACE(probe, args...) STAP_PROBEV(ibus_chewing, probe, ##args)
+#else
+#define IBUS_CHEWING_TRACE(probe, args...)                                                         \
+    do {                                                                                           \
+    } while (0)
+#endif
@@ -4,6 +4,8 @@
  */
 
 #include "IBusChewingUtil.h"
+#include "MakerDialogUtil.h"
+#include <unistd.h>
 
 /*=====================================
  * Tone
@@ -314,7 +316,8 @@ const gchar *modifier_get_string(guint modifier) {
 
 #define MODIFIER_BUFFER_SIZE 100
 const gchar *modifiers_to_string(guint modifier) {
-    static gchar modifierBuf[MODIFIER_BUFFER_SIZE];
+    /* Logged from both the main and the worker thread */
+    static _Thread_local gchar modifierBuf[MODIFIER_BUFFER_SIZE];
 
     g_strlcpy(modifierBuf, "", MODIFIER_BUFFER_SIZE);
     gboolean first = TRUE;
@@ -336,3 +339,78 @@ const gchar *modifiers_to_string(guint modifier) {
     }
     return modifierBuf;
 }
+
+/*=====================================
+ * Startup timeline
+ */
+
+#define STARTUP_PHASES_MAX 16
+
+static struct {
+    gboolean running;
+    gint64 startRealTime;
+    gint64 start;
+    guint len;
+    const gchar *phases[STARTUP_PHASES_MAX];
+    gint64 ends[STARTUP_PHASES_MAX];
+    gchar *report;
+} startup;
+
+void ibus_chewing_startup_begin(void) {
+    startup.startRealTime = g_get_real_time();
+    startup.start = g_get_monotonic_time();
+    startup.len = 0;
+    startup.running = TRUE;
+}
+
+void ibus_chewing_startup_mark(const gchar *phase) {
+    if (!startup.running || startup.len >= STARTUP_PHASES_MAX) {
+        return;
+    }
+    startup.phases[startup.len] = phase;
+    startup.ends[startup.len] = g_get_monotonic_time();
+    startup.len++;
+}
+
+void ibus_chewing_startup_set_report(const gchar *filename) {
+    g_free(startup.report);
+    startup.report = g_strdup(filename);
+}
+
+void ibus_chewing_startup_finish(void) {
+    if (!startup.running) {
+        return;
+    }
+    startup.running = FALSE;
+    if (startup.report == NULL) {
+        return;
+    }
+
+    GString *json = g_string_new(NULL);
+    gint64 phaseStart = startup.start;
+
+    g_string_append_printf(json,
+                           "{\n  \"pid\": %d,\n  \"start_realtime_us\": %" G_GINT64_FORMAT
+                           ",\n  \"phases\": [",
+                           (gint)getpid(), startup.startRealTime);
+    for (guint i = 0; i < startup.len; i++) {
+        g_string_append_printf(json,
+                               "%s\n    {\"name\": \"%s\", \"start_us\": %" G_GINT64_FORMAT
+                               ", \"duration_us\": %" G_GINT64_FORMAT "}",
+                               (i > 0) ? "," : "", startup.phases[i],
+                               phaseStart - startup.start, startup.ends[i] - phaseStart);
+        phaseStart = startup.ends[i];
+    }
+    g_string_append_printf(json, "\n  ],\n  \"total_us\": %" G_GINT64_FORMAT "\n}\n",
+                           phaseStart - startup.start);
+
+    GError *error = NULL;
+
+    if (!g_file_set_contents(startup.report, json->str, json->len, &error)) {
+        IBUS_CHEWING_LOG(WARN, "startup_finish() cannot write %s: %s", startup.report,
+                         error->message);
+        g_error_free(error);
+    }
+    g_string_free(json, TRUE);
+    g_clear_pointer(&startup.report, g_free);
+}
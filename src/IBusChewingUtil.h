@@ -38,8 +38,12 @@
 
 #define IBUS_CHEWING_LOG_DOMAIN "ibus-chewing"
 
+/* Arguments are only evaluated when the level is enabled */
 #define IBUS_CHEWING_LOG(level, msg, args...)                                  \
-    mkdg_log_domain(IBUS_CHEWING_LOG_DOMAIN, level, msg, ##args)
+    do {                                                                       \
+        if (mkdg_log_enabled(level))                                           \
+            mkdg_log_domain(IBUS_CHEWING_LOG_DOMAIN, level, msg, ##args);      \
+    } while (0)
 
 typedef guint KSym;
 
@@ -74,4 +78,20 @@ const gchar *modifier_get_string(guint modifier);
 
 const gchar *modifiers_to_string(guint modifier);
 
+/*
+ * Startup timeline.
+ * Each mark ends the phase that began at the previous mark.
+ * Marks are ignored before ibus_chewing_startup_begin() and after
+ * ibus_chewing_startup_finish(), so only the first engine is timed.
+ * Phase names are kept by reference, pass string literals.
+ */
+void ibus_chewing_startup_begin(void);
+
+void ibus_chewing_startup_mark(const gchar *phase);
+
+/* Write the timeline as JSON to @filename when finished, NULL to discard it */
+void ibus_chewing_startup_set_report(const gchar *filename);
+
+void ibus_chewing_startup_finish(void);
+
 #endif /* _IBUS_CHEWING_UTIL_H_ */
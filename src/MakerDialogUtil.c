@@ -2,16 +2,16 @@
 #include <glib.h>
 #include <stdarg.h>
 
-static MkdgLogLevel debugLevel = WARN;
+MkdgLogLevel mkdgLogLevel = WARN;
 
 #define MKDG_LOG_DOMAIN_LEN 20
 static gchar mkdgLogDomain[MKDG_LOG_DOMAIN_LEN] = "MKDG";
 
-void mkdg_log_set_level(MkdgLogLevel level) { debugLevel = level; }
+void mkdg_log_set_level(MkdgLogLevel level) { mkdgLogLevel = level; }
 
 void mkdg_logv_domain(const gchar *domain, MkdgLogLevel level,
                       const gchar *format, va_list argList) {
-    if (level > debugLevel)
+    if (level > mkdgLogLevel)
         return;
     GLogLevelFlags flagSet;
 
@@ -36,7 +36,7 @@ void mkdg_logv_domain(const gchar *domain, MkdgLogLevel level,
 }
 
 void mkdg_log(MkdgLogLevel level, const gchar *format, ...) {
-    if (level > debugLevel)
+    if (level > mkdgLogLevel)
         return;
     va_list argList;
 
@@ -47,7 +47,7 @@ void mkdg_log(MkdgLogLevel level, const gchar *format, ...) {
 
 void mkdg_log_domain(const gchar *domain, MkdgLogLevel level,
                      const gchar *format, ...) {
-    if (level > debugLevel)
+    if (level > mkdgLogLevel)
         return;
     va_list argList;
 
@@ -50,6 +50,30 @@
  */
 typedef enum { ERROR, WARN, MSG, INFO, DEBUG } MkdgLogLevel;
 
+/**
+ * MKDG_LOG_COMPILE_LEVEL:
+ *
+ * Most verbose level that is compiled in. Logging calls above this level
+ * are removed by the compiler regardless of mkdg_log_set_level().
+ * Release builds set it to MSG.
+ */
+#ifndef MKDG_LOG_COMPILE_LEVEL
+#define MKDG_LOG_COMPILE_LEVEL DEBUG
+#endif
+
+/* Current level, only change it with mkdg_log_set_level() */
+extern MkdgLogLevel mkdgLogLevel;
+
+/**
+ * mkdg_log_enabled:
+ * @level: Message verbose level.
+ *
+ * Whether a message of @level would be shown.
+ * With a constant @level it costs at most one branch.
+ */
+#define mkdg_log_enabled(level)                                                \
+    ((level) <= MKDG_LOG_COMPILE_LEVEL && G_UNLIKELY((level) <= mkdgLogLevel))
+
 void mkdg_log_set_level(MkdgLogLevel level);
 
 void mkdg_log(MkdgLogLevel level, const gchar *format, ...);
@@ -29,12 +29,92 @@
 
 G_BEGIN_DECLS
 
+/**
+ * IBusChewingSentText:
+ * @valid:   Whether the other fields hold what IBus is showing.
+ * @hash:    Hash of @text.
+ * @text:    Text last sent to IBus.
+ * @cursor:  Cursor position last sent to IBus.
+ * @visible: Visibility last sent to IBus.
+ *
+ * A text surface (pre-edit or auxiliary text) as last sent to IBus,
+ * so identical updates can be skipped.
+ */
+typedef struct {
+    gboolean valid;
+    guint hash;
+    GString *text;
+    guint cursor;
+    gboolean visible;
+} IBusChewingSentText;
+
+/**
+ * IBusChewingPendingSetting:
+ *
+ * Settings stored by set_property() but not yet pushed to libchewing
+ * or the lookup table. They are applied together by
+ * ibus_chewing_engine_apply_settings().
+ */
+typedef enum {
+    PENDING_KB_TYPE = 1 << 0,
+    PENDING_AUTO_SHIFT_CUR = 1 << 1,
+    PENDING_ADD_PHRASE_DIRECTION = 1 << 2,
+    PENDING_EASY_SYMBOL_INPUT = 1 << 3,
+    PENDING_ESC_CLEAN_ALL_BUF = 1 << 4,
+    PENDING_ENABLE_FULLWIDTH_TOGGLE_KEY = 1 << 5,
+    PENDING_MAX_CHI_SYMBOL_LEN = 1 << 6,
+    PENDING_PHRASE_CHOICE_FROM_LAST = 1 << 7,
+    PENDING_SPACE_AS_SELECTION = 1 << 8,
+    PENDING_CONVERSION_ENGINE = 1 << 9,
+    PENDING_LOOKUP_TABLE = 1 << 10,
+    PENDING_DEFERRED_LEARNING = 1 << 11,
+} IBusChewingPendingSetting;
+
+/**
+ * IBusChewingEngineStats:
+ * @updatesSent:     UI updates (commit, pre-edit, aux, lookup table) sent to IBus.
+ * @updatesSaved:    UI updates skipped because nothing changed.
+ * @objectsCreated:  IBusText, IBusAttrList and IBusAttribute objects created
+ *                   for the pre-edit, aux and outgoing texts after init.
+ * @settingsApplied: Passes of ibus_chewing_engine_apply_settings() that
+ *                   pushed pending settings.
+ * @keysPassedThrough: Keys returned to the client by the English sub-mode
+ *                   fast path, without libchewing calls or UI updates.
+ * @releasesShortCircuited: Key releases answered without processing them
+ *                   or updating the UI.
+ * @uiFlushes:       UI updates sent from the coalescing idle source,
+ *                   each covering one or more keys.
+ * @keysLate:        Keys reported as handled because the worker thread did not
+ *                   answer within worker-key-timeout.
+ * @phrasesLearned:  Committed phrases learned in batches by deferred-learning.
+ * @propertyUpdatesSaved: Property refreshes not sent because the panel
+ *                   already shows the property that way.
+ * @focusClearsSkipped: Focus-ins that found nothing to clear and kept the texts.
+ */
+typedef struct {
+    guint64 updatesSent;
+    guint64 updatesSaved;
+    guint64 objectsCreated;
+    guint64 settingsApplied;
+    guint64 keysPassedThrough;
+    guint64 releasesShortCircuited;
+    guint64 uiFlushes;
+    guint64 keysLate;
+    guint64 phrasesLearned;
+    guint64 propertyUpdatesSaved;
+    guint64 focusClearsSkipped;
+} IBusChewingEngineStats;
+
 struct _IBusChewingEngine {
     IBusEngine __parent__;
     IBusChewingPreEdit *icPreEdit;
     IBusText *preEditText;
     IBusText *auxText;
     IBusText *outgoingText;
+
+    /* Texts are never changed once made, so these are shared by all their uses */
+    GHashTable *staticTexts;
+    GHashTable *pageTexts;
     IBusProperty *InputMode;
     IBusProperty *AlnumSize;
     IBusProperty *setup_prop;
@@ -46,6 +126,41 @@ struct _IBusChewingEngine {
     gboolean pending_notify_chinese_english_mode;
     gboolean pending_notify_fullwidth_mode;
 
+    /* UI state last sent to IBus */
+    IBusChewingSentText lastPreEdit;
+    IBusChewingSentText lastAux;
+    gboolean lastTableValid;
+    gboolean lastTableShow;
+    guint lastTableGeneration;
+    guint lastTableCursor;
+    IBusChewingEngineStats stats;
+
+    /* Property states the panel shows, valid while the properties are registered */
+    gboolean lastPropsValid;
+    gboolean lastPropChinese;
+    gboolean lastPropFullwidth;
+
+    IBusChewingPendingSetting pendingSettings;
+    guint applySettingsSource;
+
+    /* UI update deferred to an idle source by coalesce-ui-updates */
+    guint flushUiSource;
+
+    /* worker-thread: the worker owns icPreEdit while workerKeys is not empty */
+    GThread *worker;
+    GAsyncQueue *workerQueue;
+    GQueue workerKeys;
+    GMutex workerLock;
+    GCond workerCond;
+    /* Late keys were collected but the UI has not been updated for them */
+    gboolean workerUiBehind;
+    gboolean workerRefreshProperties;
+
+    /* deferred-learning: flushes the phrases committed since it was added */
+    guint learnSource;
+    /* learnSource is an idle source, the queue is full */
+    gboolean learnSoon;
+
     char *prop_kb_type;
     char *prop_sel_keys;
     int prop_cand_per_page;
@@ -67,6 +182,18 @@ struct _IBusChewingEngine {
     char *prop_conversion_engine;
     gboolean prop_ibus_use_system_layout;
     gboolean prop_notify_mode_change;
+    gboolean prop_coalesce_ui_updates;
+    gboolean prop_worker_thread;
+    int prop_worker_key_timeout;
+    gboolean prop_deferred_learning;
+    int prop_learning_interval;
+
+    /* String properties decoded by set_property() */
+    ChewingKbType kbType;
+    EnglishCase defaultEnglishCase;
+    ChiEngToggle chiEngModeToggle;
+    SyncCapsLock syncCapsLock;
+    ConversionEngine conversionEngine;
 
     IBusText *InputMode_label_chi;
     IBusText *InputMode_label_eng;
@@ -104,6 +231,9 @@ void commit_text(IBusChewingEngine *self);
 
 void ibus_chewing_engine_restore_mode(IBusChewingEngine *self);
 void ibus_chewing_engine_update(IBusChewingEngine *self);
+void ibus_chewing_engine_flush_ui(IBusChewingEngine *self);
+void ibus_chewing_engine_worker_sync(IBusChewingEngine *self);
+void ibus_chewing_engine_flush_learning(IBusChewingEngine *self);
 void ibus_chewing_engine_refresh_property(IBusChewingEngine *self, const gchar *prop_name);
 
 G_END_DECLS
\ No newline at end of file
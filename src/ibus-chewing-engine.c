@@ -21,12 +21,12 @@
  */
 #include "ibus-chewing-engine.h"
 #include "IBusChewingPreEdit.h"
+#include "IBusChewingTrace.h"
 #include "IBusChewingUtil.h"
 #include "MakerDialogUtil.h"
 #include "ibus-chewing-engine-private.h"
 #include <chewing.h>
 #include <glib/gi18n.h>
-#include <gtk/gtk.h>
 #include <ibus.h>
 
 static const GEnumValue _engine_flag_values[] = {
@@ -36,6 +36,8 @@ static const GEnumValue _engine_flag_values[] = {
     {ENGINE_FLAG_IS_PASSWORD, (char *)"ENGINE_FLAG_IS_PASSWORD", (char *)"is-password"},
     {ENGINE_FLAG_PROPERTIES_REGISTERED, (char *)"ENGINE_FLAG_PROPERTIES_REGISTERED",
      (char *)"properties-registered"},
+    {ENGINE_FLAG_CAPS_LOCK_KNOWN, (char *)"ENGINE_FLAG_CAPS_LOCK_KNOWN", (char *)"caps-lock-known"},
+    {ENGINE_FLAG_CAPS_LOCK, (char *)"ENGINE_FLAG_CAPS_LOCK", (char *)"caps-lock"},
     {0, NULL, NULL}};
 
 GType engine_flag_get_type(void) {
@@ -46,41 +48,56 @@ GType engine_flag_get_type(void) {
     return type;
 }
 
-static ChewingKbType kb_type_get_index(const gchar *kb_type) {
-    // The order of this list should match libchewing's KB enum
-    //
-    // clang-format off
-    const gchar *kb_type_ids[] = {
-        "default",
-        "hsu",
-        "ibm",
-        "gin_yieh",
-        "eten",
-        "eten26",
-        "dvorak",
-        "dvorak_hsu",
-        "dachen_26",
-        "hanyu",
-        "thl_pinying",
-        "mps2_pinyin",
-        "carpalx",
-        "colemak_dh_ansi",
-        "colemak_dh_orth",
-        "workman",
-        "colemak",
-        NULL
-    };
-    // clang-format on
-    ChewingKbType i = 0;
-
-    for (i = 0; kb_type_ids[i] != NULL; i++) {
-        if (strcmp(kb_type, kb_type_ids[i]) == 0) {
+/* Index of value in the NULL terminated nicks, or fallback if it is not there */
+static gint nick_get_index(const gchar *const *nicks, const gchar *value, gint fallback) {
+    if (value == NULL) {
+        return fallback;
+    }
+    for (gint i = 0; nicks[i] != NULL; i++) {
+        if (strcmp(value, nicks[i]) == 0) {
             return i;
         }
     }
-    return CHEWING_KBTYPE_INVALID;
+    return fallback;
 }
 
+// The order of this list should match libchewing's KB enum
+//
+// clang-format off
+static const gchar *const kbTypeNicks[] = {
+    "default",
+    "hsu",
+    "ibm",
+    "gin_yieh",
+    "eten",
+    "eten26",
+    "dvorak",
+    "dvorak_hsu",
+    "dachen_26",
+    "hanyu",
+    "thl_pinying",
+    "mps2_pinyin",
+    "carpalx",
+    "colemak_dh_ansi",
+    "colemak_dh_orth",
+    "workman",
+    "colemak",
+    NULL
+};
+// clang-format on
+
+/* The order of these lists should match their enums */
+static const gchar *const englishCaseNicks[] = {"no default", "lowercase", "uppercase", NULL};
+static const gchar *const chiEngToggleNicks[] = {"disable", "caps_lock", "shift",
+                                                 "shift_l", "shift_r",   NULL};
+static const gchar *const syncCapsLockNicks[] = {"disable", "keyboard", "input method", NULL};
+static const gchar *const conversionEngineNicks[] = {"simple", "chewing", "fuzzy-chewing", NULL};
+
+/* Names of the IBusProperty of the language bar */
+static GQuark quarkInputMode;
+static GQuark quarkAlnumSize;
+static GQuark quarkSetupProp;
+
 typedef enum {
     PROP_KB_TYPE = 1,
     PROP_SEL_KEYS,
@@ -103,6 +120,11 @@ typedef enum {
     PROP_CONVERSION_ENGINE,
     PROP_IBUS_USE_SYSTEM_LAYOUT,
     PROP_NOTIFY_MODE_CHANGE,
+    PROP_COALESCE_UI_UPDATES,
+    PROP_WORKER_THREAD,
+    PROP_WORKER_KEY_TIMEOUT,
+    PROP_DEFERRED_LEARNING,
+    PROP_LEARNING_INTERVAL,
     N_PROPERTIES
 } IBusChewingEngineProperty;
 
@@ -130,13 +152,45 @@ static void ibus_chewing_engine_property_hide(IBusEngine *engine, const gchar *p
 
 #define ibus_text_is_empty(iText) ((iText == NULL) || STRING_IS_EMPTY(iText->text))
 
+/* Send the lookup table again on next update, whether or not it changed */
+#define ibus_chewing_engine_invalidate_lookup_table(self) (self->lastTableValid = FALSE)
+
+/* Send everything again on next update, e.g. when the client forgot it */
+#define ibus_chewing_engine_invalidate_ui(self)                                                    \
+    do {                                                                                           \
+        self->lastPreEdit.valid = FALSE;                                                           \
+        self->lastAux.valid = FALSE;                                                               \
+        ibus_chewing_engine_invalidate_lookup_table(self);                                         \
+    } while (0)
+
+#define ui_update_sent(self) (self->stats.updatesSent++)
+#define ui_update_saved(self) (self->stats.updatesSaved++)
+#define ui_object_created(self, obj) (self->stats.objectsCreated++, obj)
+
+/* Page labels "(i/N)" cached before starting over */
+#define PAGE_TEXTS_MAX 64
+
+static void ibus_chewing_engine_worker_start(IBusChewingEngine *self);
+static void ibus_chewing_engine_worker_stop(IBusChewingEngine *self);
+
 static void ibus_chewing_engine_finalize(GObject *gobject) {
     IBusChewingEngine *self = IBUS_CHEWING_ENGINE(gobject);
 
+    g_clear_handle_id(&self->applySettingsSource, g_source_remove);
+    g_clear_handle_id(&self->flushUiSource, g_source_remove);
+    ibus_chewing_engine_worker_stop(self);
+    g_mutex_clear(&self->workerLock);
+    g_cond_clear(&self->workerCond);
+    /* Phrases committed since the last flush are not lost on shutdown */
+    ibus_chewing_engine_flush_learning(self);
     ibus_chewing_pre_edit_free(self->icPreEdit);
     g_clear_object(&self->preEditText);
     g_clear_object(&self->auxText);
     g_clear_object(&self->outgoingText);
+    g_clear_pointer(&self->staticTexts, g_hash_table_unref);
+    g_clear_pointer(&self->pageTexts, g_hash_table_unref);
+    g_string_free(self->lastPreEdit.text, TRUE);
+    g_string_free(self->lastAux.text, TRUE);
     g_clear_object(&self->InputMode);
     g_clear_object(&self->AlnumSize);
     g_clear_object(&self->setup_prop);
@@ -156,64 +210,145 @@ static void ibus_chewing_engine_finalize(GObject *gobject) {
     G_OBJECT_CLASS(ibus_chewing_engine_parent_class)->finalize(gobject);
 }
 
+static void ibus_chewing_engine_resize_lookup_table(IBusChewingEngine *self) {
+    IBusChewingLookupTableConfig config = {
+        .selKeys = self->prop_sel_keys,
+        .candPerPage = self->prop_cand_per_page,
+        .vertical = self->prop_vertical_lookup_table,
+    };
+
+    ibus_chewing_lookup_table_resize(self->icPreEdit->iTable, self->icPreEdit->context, &config);
+    ibus_chewing_pre_edit_sync_sel_keys(self->icPreEdit);
+    ibus_chewing_engine_invalidate_lookup_table(self);
+}
+
+/**
+ * ibus_chewing_engine_apply_settings:
+ * @self: IBusChewingEngine instance.
+ *
+ * Push the pending settings to libchewing and the lookup table in one pass.
+ * Called before a key is processed, on start, and when the main loop is idle
+ * after a burst of setting changes.
+ */
+void ibus_chewing_engine_apply_settings(IBusChewingEngine *self) {
+    if (self->pendingSettings == 0 ||
+        !ibus_chewing_engine_has_status_flag(self, ENGINE_FLAG_INITIALIZED)) {
+        return;
+    }
+    ChewingContext *ctx = self->icPreEdit->context;
+    IBusChewingPendingSetting pending = self->pendingSettings;
+
+    IBUS_CHEWING_LOG(DEBUG, "apply_settings() pending=%x", pending);
+    self->pendingSettings = 0;
+    g_clear_handle_id(&self->applySettingsSource, g_source_remove);
+
+    if (pending & PENDING_KB_TYPE)
+        chewing_set_KBType(ctx, self->kbType);
+    if (pending & PENDING_AUTO_SHIFT_CUR)
+        chewing_set_autoShiftCur(ctx, self->prop_auto_shift_cur);
+    if (pending & PENDING_ADD_PHRASE_DIRECTION)
+        chewing_set_addPhraseDirection(ctx, self->prop_add_phrase_direction);
+    if (pending & PENDING_EASY_SYMBOL_INPUT)
+        ibus_chewing_pre_edit_set_easy_symbol_input(self->icPreEdit, self->prop_easy_symbol_input);
+    if (pending & PENDING_ESC_CLEAN_ALL_BUF)
+        ibus_chewing_pre_edit_set_esc_clean_all_buf(self->icPreEdit, self->prop_esc_clean_all_buf);
+    if (pending & PENDING_ENABLE_FULLWIDTH_TOGGLE_KEY)
+        chewing_config_set_int(ctx, "chewing.enable_fullwidth_toggle_key",
+                               self->prop_enable_fullwidth_toggle_key);
+    if (pending & PENDING_MAX_CHI_SYMBOL_LEN)
+        chewing_set_maxChiSymbolLen(ctx, self->prop_max_chi_symbol_len);
+    if (pending & PENDING_PHRASE_CHOICE_FROM_LAST)
+        chewing_set_phraseChoiceRearward(ctx, self->prop_phrase_choice_from_last);
+    if (pending & PENDING_SPACE_AS_SELECTION)
+        chewing_set_spaceAsSelection(ctx, self->prop_space_as_selection);
+    if ((pending & PENDING_CONVERSION_ENGINE) &&
+        self->conversionEngine != CONVERSION_ENGINE_INVALID)
+        chewing_config_set_int(ctx, "chewing.conversion_engine", self->conversionEngine);
+    if (pending & PENDING_LOOKUP_TABLE)
+        ibus_chewing_engine_resize_lookup_table(self);
+    if (pending & PENDING_DEFERRED_LEARNING)
+        ibus_chewing_pre_edit_set_defer_learning(self->icPreEdit, self->prop_deferred_learning);
+    self->stats.settingsApplied++;
+}
+
+static gboolean apply_settings_idle(gpointer user_data) {
+    IBusChewingEngine *self = IBUS_CHEWING_ENGINE(user_data);
+
+    self->applySettingsSource = 0;
+    ibus_chewing_engine_worker_sync(self);
+    ibus_chewing_engine_apply_settings(self);
+    return G_SOURCE_REMOVE;
+}
+
+/* A burst of changes, e.g. dconf notifications from the setup tool, is applied once */
+static void ibus_chewing_engine_defer_setting(IBusChewingEngine *self,
+                                              IBusChewingPendingSetting pending) {
+    self->pendingSettings |= pending;
+    if (ibus_chewing_engine_has_status_flag(self, ENGINE_FLAG_INITIALIZED) &&
+        self->applySettingsSource == 0) {
+        self->applySettingsSource = g_idle_add(apply_settings_idle, self);
+    }
+}
+
 static void ibus_chewing_engine_set_property(GObject *object, guint property_id,
                                              const GValue *value, GParamSpec *pspec) {
     IBusChewingEngine *self = IBUS_CHEWING_ENGINE(object);
-    ChewingContext *ctx = self->icPreEdit->context;
+
+    /* The worker reads the settings and owns libchewing while it has keys */
+    ibus_chewing_engine_worker_sync(self);
 
     switch ((IBusChewingEngineProperty)property_id) {
     case PROP_KB_TYPE:
         g_free(self->prop_kb_type);
         self->prop_kb_type = g_value_dup_string(value);
-        chewing_set_KBType(self->icPreEdit->context, kb_type_get_index(self->prop_kb_type));
+        self->kbType = nick_get_index(kbTypeNicks, self->prop_kb_type, CHEWING_KBTYPE_INVALID);
+        ibus_chewing_engine_defer_setting(self, PENDING_KB_TYPE);
         break;
     case PROP_SEL_KEYS:
         g_free(self->prop_sel_keys);
         self->prop_sel_keys = g_value_dup_string(value);
-        // FIXME
-        ibus_chewing_lookup_table_resize(self->icPreEdit->iTable, ctx);
+        ibus_chewing_engine_defer_setting(self, PENDING_LOOKUP_TABLE);
         break;
     case PROP_CAND_PER_PAGE:
         self->prop_cand_per_page = g_value_get_int(value);
-        // FIXME
-        ibus_chewing_lookup_table_resize(self->icPreEdit->iTable, ctx);
+        ibus_chewing_engine_defer_setting(self, PENDING_LOOKUP_TABLE);
         break;
     case PROP_VERTICAL_LOOKUP_TABLE:
         self->prop_vertical_lookup_table = g_value_get_boolean(value);
-        // FIXME
-        ibus_chewing_lookup_table_resize(self->icPreEdit->iTable, ctx);
+        ibus_chewing_engine_defer_setting(self, PENDING_LOOKUP_TABLE);
         break;
     case PROP_AUTO_SHIFT_CUR:
         self->prop_auto_shift_cur = g_value_get_boolean(value);
-        chewing_set_autoShiftCur(ctx, self->prop_auto_shift_cur);
+        ibus_chewing_engine_defer_setting(self, PENDING_AUTO_SHIFT_CUR);
         break;
     case PROP_ADD_PHRASE_DIRECTION:
         self->prop_add_phrase_direction = g_value_get_boolean(value);
-        chewing_set_addPhraseDirection(ctx, self->prop_add_phrase_direction);
+        ibus_chewing_engine_defer_setting(self, PENDING_ADD_PHRASE_DIRECTION);
         break;
     case PROP_CLEAN_BUFFER_FOCUS_OUT:
         self->prop_clean_buffer_focus_out = g_value_get_boolean(value);
         break;
     case PROP_EASY_SYMBOL_INPUT:
         self->prop_easy_symbol_input = g_value_get_boolean(value);
-        chewing_set_easySymbolInput(ctx, self->prop_easy_symbol_input);
+        ibus_chewing_engine_defer_setting(self, PENDING_EASY_SYMBOL_INPUT);
         break;
     case PROP_ESC_CLEAN_ALL_BUF:
         self->prop_esc_clean_all_buf = g_value_get_boolean(value);
-        chewing_set_escCleanAllBuf(ctx, self->prop_esc_clean_all_buf);
+        ibus_chewing_engine_defer_setting(self, PENDING_ESC_CLEAN_ALL_BUF);
         break;
     case PROP_ENABLE_FULLWIDTH_TOGGLE_KEY:
         self->prop_enable_fullwidth_toggle_key = g_value_get_boolean(value);
-        chewing_config_set_int(ctx, "chewing.enable_fullwidth_toggle_key",
-                               self->prop_enable_fullwidth_toggle_key);
+        ibus_chewing_engine_defer_setting(self, PENDING_ENABLE_FULLWIDTH_TOGGLE_KEY);
         break;
     case PROP_MAX_CHI_SYMBOL_LEN:
         self->prop_max_chi_symbol_len = g_value_get_int(value);
-        chewing_set_maxChiSymbolLen(ctx, self->prop_max_chi_symbol_len);
+        ibus_chewing_engine_defer_setting(self, PENDING_MAX_CHI_SYMBOL_LEN);
         break;
     case PROP_DEFAULT_ENGLISH_CASE:
         g_free(self->prop_default_english_case);
         self->prop_default_english_case = g_value_dup_string(value);
+        self->defaultEnglishCase = nick_get_index(englishCaseNicks, self->prop_default_english_case,
+                                                  ENGLISH_CASE_NO_DEFAULT);
         break;
     case PROP_DEFAULT_USE_ENGLISH_MODE:
         self->prop_default_use_english_mode = g_value_get_boolean(value);
@@ -221,27 +356,35 @@ static void ibus_chewing_engine_set_property(GObject *object, guint property_id,
     case PROP_CHI_ENG_MODE_TOGGLE:
         g_free(self->prop_chi_eng_mode_toggle);
         self->prop_chi_eng_mode_toggle = g_value_dup_string(value);
+        self->chiEngModeToggle = nick_get_index(chiEngToggleNicks, self->prop_chi_eng_mode_toggle,
+                                                CHI_ENG_TOGGLE_DISABLE);
         break;
     case PROP_PHRASE_CHOICE_FROM_LAST:
         self->prop_phrase_choice_from_last = g_value_get_boolean(value);
-        chewing_set_phraseChoiceRearward(ctx, self->prop_phrase_choice_from_last);
+        ibus_chewing_engine_defer_setting(self, PENDING_PHRASE_CHOICE_FROM_LAST);
         break;
     case PROP_SPACE_AS_SELECTION:
         self->prop_space_as_selection = g_value_get_boolean(value);
-        chewing_set_spaceAsSelection(ctx, self->prop_space_as_selection);
+        ibus_chewing_engine_defer_setting(self, PENDING_SPACE_AS_SELECTION);
         break;
     case PROP_SYNC_CAPS_LOCK:
         g_free(self->prop_sync_caps_lock);
         self->prop_sync_caps_lock = g_value_dup_string(value);
-        if (strcmp(self->prop_sync_caps_lock, "keyboard") == 0) {
+        self->syncCapsLock =
+            nick_get_index(syncCapsLockNicks, self->prop_sync_caps_lock, SYNC_CAPS_LOCK_DISABLE);
+        switch (self->syncCapsLock) {
+        case SYNC_CAPS_LOCK_KEYBOARD:
             ibus_chewing_pre_edit_set_flag(self->icPreEdit, FLAG_SYNC_FROM_KEYBOARD);
             ibus_chewing_pre_edit_clear_flag(self->icPreEdit, FLAG_SYNC_FROM_IM);
-        } else if (strcmp(self->prop_sync_caps_lock, "input method") == 0) {
+            break;
+        case SYNC_CAPS_LOCK_INPUT_METHOD:
             ibus_chewing_pre_edit_set_flag(self->icPreEdit, FLAG_SYNC_FROM_IM);
             ibus_chewing_pre_edit_clear_flag(self->icPreEdit, FLAG_SYNC_FROM_KEYBOARD);
-        } else {
+            break;
+        default:
             ibus_chewing_pre_edit_clear_flag(self->icPreEdit,
                                              FLAG_SYNC_FROM_IM | FLAG_SYNC_FROM_KEYBOARD);
+            break;
         }
         break;
     case PROP_SHOW_PAGE_NUMBER:
@@ -250,20 +393,42 @@ static void ibus_chewing_engine_set_property(GObject *object, guint property_id,
     case PROP_CONVERSION_ENGINE:
         g_free(self->prop_conversion_engine);
         self->prop_conversion_engine = g_value_dup_string(value);
-        if (!g_strcmp0(self->prop_conversion_engine, "simple")) {
-            chewing_config_set_int(ctx, "chewing.conversion_engine", 0);
-        } else if (!g_strcmp0(self->prop_conversion_engine, "chewing")) {
-            chewing_config_set_int(ctx, "chewing.conversion_engine", 1);
-        } else if (!g_strcmp0(self->prop_conversion_engine, "fuzzy-chewing")) {
-            chewing_config_set_int(ctx, "chewing.conversion_engine", 2);
-        }
+        self->conversionEngine = nick_get_index(conversionEngineNicks, self->prop_conversion_engine,
+                                                CONVERSION_ENGINE_INVALID);
+        ibus_chewing_engine_defer_setting(self, PENDING_CONVERSION_ENGINE);
         break;
     case PROP_IBUS_USE_SYSTEM_LAYOUT:
         self->prop_ibus_use_system_layout = g_value_get_boolean(value);
+        ibus_chewing_pre_edit_set_keymap(
+            self->icPreEdit, self->prop_ibus_use_system_layout ? NULL : self->keymap_us);
         break;
     case PROP_NOTIFY_MODE_CHANGE:
         self->prop_notify_mode_change = g_value_get_boolean(value);
         break;
+    case PROP_COALESCE_UI_UPDATES:
+        self->prop_coalesce_ui_updates = g_value_get_boolean(value);
+        if (!self->prop_coalesce_ui_updates) {
+            ibus_chewing_engine_flush_ui(self);
+        }
+        break;
+    case PROP_WORKER_THREAD:
+        self->prop_worker_thread = g_value_get_boolean(value);
+        if (self->prop_worker_thread) {
+            ibus_chewing_engine_worker_start(self);
+        } else {
+            ibus_chewing_engine_worker_stop(self);
+        }
+        break;
+    case PROP_WORKER_KEY_TIMEOUT:
+        self->prop_worker_key_timeout = g_value_get_int(value);
+        break;
+    case PROP_DEFERRED_LEARNING:
+        self->prop_deferred_learning = g_value_get_boolean(value);
+        ibus_chewing_engine_defer_setting(self, PENDING_DEFERRED_LEARNING);
+        break;
+    case PROP_LEARNING_INTERVAL:
+        self->prop_learning_interval = g_value_get_int(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -337,6 +502,21 @@ static void ibus_chewing_engine_get_property(GObject *object, guint property_id,
     case PROP_NOTIFY_MODE_CHANGE:
         g_value_set_boolean(value, self->prop_notify_mode_change);
         break;
+    case PROP_COALESCE_UI_UPDATES:
+        g_value_set_boolean(value, self->prop_coalesce_ui_updates);
+        break;
+    case PROP_WORKER_THREAD:
+        g_value_set_boolean(value, self->prop_worker_thread);
+        break;
+    case PROP_WORKER_KEY_TIMEOUT:
+        g_value_set_int(value, self->prop_worker_key_timeout);
+        break;
+    case PROP_DEFERRED_LEARNING:
+        g_value_set_boolean(value, self->prop_deferred_learning);
+        break;
+    case PROP_LEARNING_INTERVAL:
+        g_value_set_int(value, self->prop_learning_interval);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -351,6 +531,10 @@ static void ibus_chewing_engine_class_init(IBusChewingEngineClass *klass) {
     object_class->set_property = ibus_chewing_engine_set_property;
     object_class->get_property = ibus_chewing_engine_get_property;
 
+    quarkInputMode = g_quark_from_static_string("InputMode");
+    quarkAlnumSize = g_quark_from_static_string("AlnumSize");
+    quarkSetupProp = g_quark_from_static_string("setup_prop");
+
     ibus_engine_class->reset = ibus_chewing_engine_reset;
     ibus_engine_class->page_up = ibus_chewing_engine_page_up;
     ibus_engine_class->page_down = ibus_chewing_engine_page_down;
@@ -413,6 +597,16 @@ static void ibus_chewing_engine_class_init(IBusChewingEngineClass *klass) {
         g_param_spec_boolean("use-system-keyboard-layout", NULL, NULL, FALSE, G_PARAM_READWRITE);
     obj_properties[PROP_NOTIFY_MODE_CHANGE] =
         g_param_spec_boolean("notify-mode-change", NULL, NULL, TRUE, G_PARAM_READWRITE);
+    obj_properties[PROP_COALESCE_UI_UPDATES] =
+        g_param_spec_boolean("coalesce-ui-updates", NULL, NULL, FALSE, G_PARAM_READWRITE);
+    obj_properties[PROP_WORKER_THREAD] =
+        g_param_spec_boolean("worker-thread", NULL, NULL, FALSE, G_PARAM_READWRITE);
+    obj_properties[PROP_WORKER_KEY_TIMEOUT] =
+        g_param_spec_int("worker-key-timeout", NULL, NULL, 1, 1000, 50, G_PARAM_READWRITE);
+    obj_properties[PROP_DEFERRED_LEARNING] =
+        g_param_spec_boolean("deferred-learning", NULL, NULL, FALSE, G_PARAM_READWRITE);
+    obj_properties[PROP_LEARNING_INTERVAL] =
+        g_param_spec_int("learning-interval", NULL, NULL, 1, 3600, 30, G_PARAM_READWRITE);
 
     g_object_class_install_properties(object_class, N_PROPERTIES, obj_properties);
 }
@@ -420,6 +614,7 @@ static void ibus_chewing_engine_class_init(IBusChewingEngineClass *klass) {
 #define bind_settings(key) g_settings_bind(settings, key, self, key, G_SETTINGS_BIND_DEFAULT)
 
 static void ibus_chewing_engine_init(IBusChewingEngine *self) {
+    ibus_chewing_startup_mark("ibus_create_engine");
     self->InputMode_label_chi =
         g_object_ref_sink(ibus_text_new_from_static_string(_("Switch to Alphanumeric Mode")));
     self->InputMode_label_eng =
@@ -443,13 +638,35 @@ static void ibus_chewing_engine_init(IBusChewingEngine *self) {
     self->setup_prop_symbol = g_object_ref_sink(ibus_text_new_from_static_string("訂"));
     self->emptyText = g_object_ref_sink(ibus_text_new_from_static_string(""));
 
-    self->preEditText = NULL;
-    self->auxText = NULL;
-    self->outgoingText = NULL;
+    self->preEditText = g_object_ref(self->emptyText);
+    self->auxText = g_object_ref(self->emptyText);
+    self->outgoingText = g_object_ref(self->emptyText);
+    self->staticTexts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_object_unref);
+    self->pageTexts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_object_unref);
     self->statusFlags = 0;
     self->capabilite = 0;
     self->pending_notify_chinese_english_mode = FALSE;
     self->pending_notify_fullwidth_mode = FALSE;
+    self->lastPreEdit = (IBusChewingSentText){FALSE, 0, g_string_new(NULL), 0, FALSE};
+    self->lastAux = (IBusChewingSentText){FALSE, 0, g_string_new(NULL), 0, FALSE};
+    self->lastTableValid = FALSE;
+    self->lastTableShow = FALSE;
+    self->lastTableGeneration = 0;
+    self->lastTableCursor = 0;
+    self->stats = (IBusChewingEngineStats){0};
+    self->pendingSettings = 0;
+    self->applySettingsSource = 0;
+    self->flushUiSource = 0;
+    self->worker = NULL;
+    self->workerQueue = NULL;
+    g_queue_init(&self->workerKeys);
+    g_mutex_init(&self->workerLock);
+    g_cond_init(&self->workerCond);
+    self->workerUiBehind = FALSE;
+    self->workerRefreshProperties = FALSE;
+    self->lastPropsValid = FALSE;
+    self->lastPropChinese = FALSE;
+    self->lastPropFullwidth = FALSE;
     self->InputMode = g_object_ref_sink(
         ibus_property_new("InputMode", PROP_TYPE_NORMAL, self->InputMode_label_chi, NULL,
                           self->InputMode_tooltip, TRUE, TRUE, PROP_STATE_UNCHECKED, NULL));
@@ -467,18 +684,31 @@ static void ibus_chewing_engine_init(IBusChewingEngine *self) {
         return;
     }
 
+    ibus_chewing_startup_mark("engine_objects");
     self->icPreEdit = ibus_chewing_pre_edit_new();
 
     g_assert(self->icPreEdit);
+    ibus_chewing_startup_mark("chewing_new");
 
     self->icPreEdit->engine = IBUS_ENGINE(self);
+    ibus_chewing_pre_edit_set_keymap(self->icPreEdit, self->keymap_us);
 
     /* init properties */
     ibus_prop_list_append(self->prop_list, self->InputMode);
     ibus_prop_list_append(self->prop_list, self->AlnumSize);
     ibus_prop_list_append(self->prop_list, self->setup_prop);
 
-    ibus_chewing_engine_set_status_flag(self, ENGINE_FLAG_INITIALIZED);
+    /* Schema defaults, in case the settings are not bound */
+    self->prop_sel_keys = g_strdup("1234567890");
+    self->prop_cand_per_page = 5;
+    self->prop_vertical_lookup_table = FALSE;
+    self->kbType = CHEWING_KBTYPE_DEFAULT;
+    self->defaultEnglishCase = ENGLISH_CASE_NO_DEFAULT;
+    self->chiEngModeToggle = CHI_ENG_TOGGLE_DISABLE;
+    self->syncCapsLock = SYNC_CAPS_LOCK_DISABLE;
+    self->conversionEngine = CONVERSION_ENGINE_INVALID;
+    self->prop_worker_key_timeout = 50;
+    self->prop_learning_interval = 30;
 
 #ifndef UNIT_TEST
     g_autoptr(GSettings) settings = g_settings_new(QUOTE_ME(PROJECT_SCHEMA_ID));
@@ -504,43 +734,131 @@ static void ibus_chewing_engine_init(IBusChewingEngine *self) {
     bind_settings("show-page-number");
     bind_settings("conversion-engine");
     bind_settings("notify-mode-change");
+    bind_settings("coalesce-ui-updates");
+    bind_settings("worker-thread");
+    bind_settings("worker-key-timeout");
+    bind_settings("deferred-learning");
+    bind_settings("learning-interval");
 
     g_settings_bind(ibus_settings, "use-system-keyboard-layout", self, "use-system-keyboard-layout",
                     G_SETTINGS_BIND_DEFAULT);
 #endif
 
+    /* Everything bound above is applied in one pass */
+    ibus_chewing_engine_set_status_flag(self, ENGINE_FLAG_INITIALIZED);
+    self->pendingSettings |= PENDING_LOOKUP_TABLE;
+    ibus_chewing_engine_apply_settings(self);
+    ibus_chewing_startup_mark("settings_bind");
+    ibus_chewing_startup_finish();
+
     IBUS_CHEWING_LOG(DEBUG, "init() Done");
 }
 
 void ibus_chewing_engine_restore_mode(IBusChewingEngine *self) {
     g_return_if_fail(self != NULL);
     g_return_if_fail(IBUS_IS_CHEWING_ENGINE(self));
-    if (ibus_chewing_engine_get_chinese_english_toggle_key(self) == 'c') {
+    if (ibus_chewing_engine_get_chinese_english_toggle_key(self) == CHI_ENG_TOGGLE_CAPS_LOCK) {
         IBUS_CHEWING_LOG(DEBUG, "restore_mode() statusFlags=%x", self->statusFlags);
-        GdkDisplay *display = gdk_display_get_default();
-
-        if (display != NULL) {
-            GdkSeat *seat = gdk_display_get_default_seat(display);
-
-            if (seat != NULL) {
-                GdkDevice *keyboard = gdk_seat_get_keyboard(seat);
-
-                /* Restore Led Mode only make sense if
-                 * display is available */
-                if (ibus_chewing_pre_edit_has_flag(self->icPreEdit, FLAG_SYNC_FROM_IM)) {
-                    IBUS_CHEWING_LOG(DEBUG, "restore_mode() "
-                                            "FLAG_SYNC_FROM_IM (deprecated)");
-                } else if (keyboard != NULL && ibus_chewing_pre_edit_has_flag(
-                                                   self->icPreEdit, FLAG_SYNC_FROM_KEYBOARD)) {
-                    IBUS_CHEWING_LOG(DEBUG, "restore_mode() "
-                                            "FLAG_SYNC_FROM_KEYBOARD");
-                    gboolean caps_lock_on = gdk_device_get_caps_lock_state(keyboard);
-                    chewing_set_ChiEngMode(self->icPreEdit->context,
-                                           caps_lock_on ? 0 : CHINESE_MODE);
-                }
-            }
-            ibus_chewing_engine_refresh_property(self, "InputMode");
+
+        /* Restore Led Mode only make sense if
+         * a key event told us the Caps Lock state */
+        if (!ibus_chewing_engine_has_status_flag(self, ENGINE_FLAG_CAPS_LOCK_KNOWN)) {
+            return;
+        }
+        if (ibus_chewing_pre_edit_has_flag(self->icPreEdit, FLAG_SYNC_FROM_IM)) {
+            IBUS_CHEWING_LOG(DEBUG, "restore_mode() "
+                                    "FLAG_SYNC_FROM_IM (deprecated)");
+        } else if (ibus_chewing_pre_edit_has_flag(self->icPreEdit, FLAG_SYNC_FROM_KEYBOARD)) {
+            IBUS_CHEWING_LOG(DEBUG, "restore_mode() "
+                                    "FLAG_SYNC_FROM_KEYBOARD");
+            gboolean caps_lock_on =
+                ibus_chewing_engine_has_status_flag(self, ENGINE_FLAG_CAPS_LOCK);
+            ibus_chewing_pre_edit_set_chi_eng_mode(self->icPreEdit, !caps_lock_on);
+        }
+        ibus_chewing_engine_refresh_property(self, "InputMode");
+    }
+}
+
+/*
+ * The lock bit of a key event is the state before the event,
+ * so pressing Caps_Lock flips it; its release carries no news.
+ * IBus tells the engine about Caps Lock only through these bits.
+ */
+static void track_caps_lock(IBusChewingEngine *self, KSym keySym, KeyModifiers unmaskedMod) {
+    gboolean on = (unmaskedMod & IBUS_LOCK_MASK) != 0;
+
+    if (keySym == IBUS_KEY_Caps_Lock) {
+        if (unmaskedMod & IBUS_RELEASE_MASK) {
+            return;
+        }
+        on = !on;
+    }
+    gboolean changed = !ibus_chewing_engine_has_status_flag(self, ENGINE_FLAG_CAPS_LOCK_KNOWN) ||
+                       !ibus_chewing_engine_has_status_flag(self, ENGINE_FLAG_CAPS_LOCK) != !on;
+
+    if (on) {
+        ibus_chewing_engine_set_status_flag(self, ENGINE_FLAG_CAPS_LOCK);
+    } else {
+        ibus_chewing_engine_clear_status_flag(self, ENGINE_FLAG_CAPS_LOCK);
+    }
+    ibus_chewing_engine_set_status_flag(self, ENGINE_FLAG_CAPS_LOCK_KNOWN);
+
+    /* Caps_Lock toggles the mode itself through the pre-edit. Any other key
+     * reports a state set before the engine knew it, e.g. before the first
+     * key or while another input context had focus. */
+    if (changed && keySym != IBUS_KEY_Caps_Lock) {
+        ibus_chewing_engine_worker_sync(self);
+        ibus_chewing_engine_restore_mode(self);
+    }
+}
+
+static gboolean learn_timeout(gpointer user_data) {
+    IBusChewingEngine *self = IBUS_CHEWING_ENGINE(user_data);
+
+    self->learnSource = 0;
+    self->learnSoon = FALSE;
+    ibus_chewing_engine_flush_learning(self);
+    return G_SOURCE_REMOVE;
+}
+
+static void worker_learn(IBusChewingEngine *self);
+
+/**
+ * ibus_chewing_engine_flush_learning:
+ * @self: IBusChewingEngine instance.
+ *
+ * Learn the phrases queued by deferred-learning now.
+ * Runs learning-interval seconds after the first of them was committed,
+ * once the main loop is idle, and on focus out and finalize.
+ * With worker-thread on, the worker learns them and the main loop does not wait.
+ */
+void ibus_chewing_engine_flush_learning(IBusChewingEngine *self) {
+    g_clear_handle_id(&self->learnSource, g_source_remove);
+    self->learnSoon = FALSE;
+    /* The queue may only be looked at while the worker has no key */
+    if (g_queue_is_empty(&self->workerKeys) &&
+        ibus_chewing_pre_edit_learn_pending(self->icPreEdit) == 0) {
+        return;
+    }
+    if (self->worker != NULL) {
+        worker_learn(self);
+        return;
+    }
+    self->stats.phrasesLearned += ibus_chewing_pre_edit_learn_flush(self->icPreEdit);
+}
+
+/* Called once the committed text is out, the database waits for an idle moment */
+static void ibus_chewing_engine_schedule_learning(IBusChewingEngine *self) {
+    if (ibus_chewing_pre_edit_learn_is_full(self->icPreEdit)) {
+        /* Do not wait for the interval, more commits would drop phrases */
+        if (!self->learnSoon) {
+            g_clear_handle_id(&self->learnSource, g_source_remove);
+            self->learnSource = g_idle_add_full(G_PRIORITY_LOW, learn_timeout, self, NULL);
+            self->learnSoon = TRUE;
         }
+    } else if (self->learnSource == 0 && ibus_chewing_pre_edit_learn_pending(self->icPreEdit) > 0) {
+        self->learnSource = g_timeout_add_seconds_full(
+            G_PRIORITY_LOW, self->prop_learning_interval, learn_timeout, self, NULL);
     }
 }
 
@@ -549,6 +867,8 @@ void ibus_chewing_engine_update(IBusChewingEngine *self) {
     g_return_if_fail(IBUS_IS_CHEWING_ENGINE(self));
     {
         IBUS_CHEWING_LOG(DEBUG, "update() statusFlags=%x", self->statusFlags);
+        /* Sends whatever a deferred flush would have sent */
+        g_clear_handle_id(&self->flushUiSource, g_source_remove);
         commit_text(self);
         update_pre_edit_text(self);
         update_aux_text(self);
@@ -556,55 +876,111 @@ void ibus_chewing_engine_update(IBusChewingEngine *self) {
         IBUS_CHEWING_LOG(DEBUG, "update() nPhoneSeq=%d statusFlags=%x",
                          chewing_get_phoneSeqLen(self->icPreEdit->context), self->statusFlags);
         update_lookup_table(self);
+        ibus_chewing_engine_schedule_learning(self);
     }
 }
 
-void ibus_chewing_engine_refresh_property(IBusChewingEngine *self,
-                                          [[maybe_unused]] const gchar *prop_name) {
-    g_return_if_fail(self != NULL);
-    g_return_if_fail(IBUS_IS_CHEWING_ENGINE(self));
-    {
-#ifndef UNIT_TEST
-        IBUS_CHEWING_LOG(DEBUG, "refresh_property(%s) status=%x", prop_name, self->statusFlags);
-
-        if (STRING_EQUALS(prop_name, "InputMode")) {
+static gboolean flush_ui_idle(gpointer user_data) {
+    IBusChewingEngine *self = IBUS_CHEWING_ENGINE(user_data);
 
-            ibus_property_set_label(self->InputMode,
-                                    ibus_chewing_pre_edit_get_chi_eng_mode(self->icPreEdit)
-                                        ? self->InputMode_label_chi
-                                        : self->InputMode_label_eng);
-
-#if IBUS_CHECK_VERSION(1, 5, 0)
-            ibus_property_set_symbol(self->InputMode,
-                                     ibus_chewing_pre_edit_get_chi_eng_mode(self->icPreEdit)
-                                         ? self->InputMode_symbol_chi
-                                         : self->InputMode_symbol_eng);
-#endif
+    self->flushUiSource = 0;
+    if (!g_queue_is_empty(&self->workerKeys)) {
+        /* The worker results catch the UI up once it is done */
+        self->workerUiBehind = TRUE;
+        return G_SOURCE_REMOVE;
+    }
+    self->stats.uiFlushes++;
+    ibus_chewing_engine_update(self);
+    return G_SOURCE_REMOVE;
+}
 
-            ibus_engine_update_property(IBUS_ENGINE(self), self->InputMode);
+/**
+ * ibus_chewing_engine_flush_ui:
+ * @self: IBusChewingEngine instance.
+ *
+ * Wait for the worker thread, then send the UI update deferred by
+ * coalesce-ui-updates now, if any.
+ * Called before the client sees anything that must come after the
+ * pending commit, such as an unconsumed key or a reset.
+ */
+void ibus_chewing_engine_flush_ui(IBusChewingEngine *self) {
+    ibus_chewing_engine_worker_sync(self);
+    if (self->flushUiSource == 0) {
+        return;
+    }
+    self->stats.uiFlushes++;
+    ibus_chewing_engine_update(self);
+}
 
-        } else if (STRING_EQUALS(prop_name, "AlnumSize")) {
+/* Keys consumed in a burst only change the state, the UI catches up once idle */
+static void ibus_chewing_engine_defer_update(IBusChewingEngine *self) {
+    if (self->flushUiSource == 0) {
+        self->flushUiSource = g_idle_add_full(G_PRIORITY_HIGH_IDLE, flush_ui_idle, self, NULL);
+    }
+}
 
-            ibus_property_set_label(self->AlnumSize, chewing_get_ShapeMode(self->icPreEdit->context)
-                                                         ? self->AlnumSize_label_full
-                                                         : self->AlnumSize_label_half);
+/* Set the label and symbol of a property from the current mode */
+static void ibus_chewing_engine_sync_property(IBusChewingEngine *self, GQuark quark) {
+    if (quark == quarkInputMode) {
+        self->lastPropChinese = is_chinese_mode(self);
+        ibus_property_set_label(self->InputMode, self->lastPropChinese
+                                                     ? self->InputMode_label_chi
+                                                     : self->InputMode_label_eng);
 
 #if IBUS_CHECK_VERSION(1, 5, 0)
-            ibus_property_set_symbol(self->AlnumSize,
-                                     chewing_get_ShapeMode(self->icPreEdit->context)
-                                         ? self->AlnumSize_symbol_full
-                                         : self->AlnumSize_symbol_half);
+        ibus_property_set_symbol(self->InputMode, self->lastPropChinese
+                                                      ? self->InputMode_symbol_chi
+                                                      : self->InputMode_symbol_eng);
 #endif
+    } else if (quark == quarkAlnumSize) {
+        self->lastPropFullwidth = is_fullwidth_mode(self);
+        ibus_property_set_label(self->AlnumSize, self->lastPropFullwidth
+                                                     ? self->AlnumSize_label_full
+                                                     : self->AlnumSize_label_half);
 
-            if (self->statusFlags & ENGINE_FLAG_PROPERTIES_REGISTERED)
-                ibus_engine_update_property(IBUS_ENGINE(self), self->AlnumSize);
-
-        } else if (STRING_EQUALS(prop_name, "setup_prop")) {
 #if IBUS_CHECK_VERSION(1, 5, 0)
-            ibus_property_set_symbol(self->setup_prop, self->setup_prop_symbol);
+        ibus_property_set_symbol(self->AlnumSize, self->lastPropFullwidth
+                                                      ? self->AlnumSize_symbol_full
+                                                      : self->AlnumSize_symbol_half);
 #endif
-            ibus_engine_update_property(IBUS_ENGINE(self), self->setup_prop);
+    } else if (quark == quarkSetupProp) {
+#if IBUS_CHECK_VERSION(1, 5, 0)
+        ibus_property_set_symbol(self->setup_prop, self->setup_prop_symbol);
+#endif
+    }
+}
+
+/* Whether the panel already shows the property as it is now */
+static gboolean ibus_chewing_engine_property_is_current(IBusChewingEngine *self, GQuark quark) {
+    if (!self->lastPropsValid) {
+        return FALSE;
+    }
+    if (quark == quarkInputMode) {
+        return self->lastPropChinese == is_chinese_mode(self);
+    } else if (quark == quarkAlnumSize) {
+        return self->lastPropFullwidth == is_fullwidth_mode(self);
+    }
+    return quark == quarkSetupProp;
+}
+
+void ibus_chewing_engine_refresh_property(IBusChewingEngine *self, const gchar *prop_name) {
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(IBUS_IS_CHEWING_ENGINE(self));
+    {
+        IBUS_CHEWING_LOG(DEBUG, "refresh_property(%s) status=%x", prop_name, self->statusFlags);
+        GQuark quark = g_quark_try_string(prop_name);
+
+        if (ibus_chewing_engine_property_is_current(self, quark)) {
+            self->stats.propertyUpdatesSaved++;
+            return;
         }
+        ibus_chewing_engine_sync_property(self, quark);
+#ifndef UNIT_TEST
+        IBusProperty *prop = ibus_chewing_engine_get_ibus_property_by_name(self, prop_name);
+
+        /* Otherwise the registration carries the new label */
+        if (prop != NULL && (self->statusFlags & ENGINE_FLAG_PROPERTIES_REGISTERED))
+            ibus_engine_update_property(IBUS_ENGINE(self), prop);
 #endif
     }
 }
@@ -619,11 +995,9 @@ void ibus_chewing_engine_refresh_property_list(IBusChewingEngine *self) {
     g_return_if_fail(self != NULL);
     g_return_if_fail(IBUS_IS_CHEWING_ENGINE(self));
     {
-#ifndef UNIT_TEST
         ibus_chewing_engine_refresh_property(self, "InputMode");
         ibus_chewing_engine_refresh_property(self, "AlnumSize");
         ibus_chewing_engine_refresh_property(self, "setup_prop");
-#endif
     }
 }
 
@@ -648,11 +1022,13 @@ static IBusProperty *ibus_chewing_engine_get_ibus_property_by_name(IBusChewingEn
     g_return_val_if_fail(self != NULL, (IBusProperty *)0);
     g_return_val_if_fail(IBUS_IS_CHEWING_ENGINE(self), (IBusProperty *)0);
     {
-        if (STRING_EQUALS(prop_name, "InputMode")) {
+        GQuark quark = g_quark_try_string(prop_name);
+
+        if (quark == quarkInputMode) {
             return self->InputMode;
-        } else if (STRING_EQUALS(prop_name, "AlnumSize")) {
+        } else if (quark == quarkAlnumSize) {
             return self->AlnumSize;
-        } else if (STRING_EQUALS(prop_name, "setup_prop")) {
+        } else if (quark == quarkSetupProp) {
             return self->setup_prop;
         }
         IBUS_CHEWING_LOG(MSG, "get_ibus_property_by_name(%s): NULL is returned", prop_name);
@@ -665,6 +1041,8 @@ static void ibus_chewing_engine_page_up(IBusEngine *engine G_GNUC_UNUSED) {
 
     if (is_password(self))
         return;
+    ibus_chewing_engine_worker_sync(self);
+    ibus_chewing_engine_apply_settings(self);
     ibus_chewing_pre_edit_process_key(self->icPreEdit, IBUS_KEY_Page_Up, 0);
     ibus_chewing_engine_update(self);
 }
@@ -674,6 +1052,8 @@ static void ibus_chewing_engine_page_down(IBusEngine *engine G_GNUC_UNUSED) {
 
     if (is_password(self))
         return;
+    ibus_chewing_engine_worker_sync(self);
+    ibus_chewing_engine_apply_settings(self);
     ibus_chewing_pre_edit_process_key(self->icPreEdit, IBUS_KEY_Page_Down, 0);
     ibus_chewing_engine_update(self);
 }
@@ -683,6 +1063,8 @@ static void ibus_chewing_engine_cursor_up(IBusEngine *engine G_GNUC_UNUSED) {
 
     if (is_password(self))
         return;
+    ibus_chewing_engine_worker_sync(self);
+    ibus_chewing_engine_apply_settings(self);
     ibus_chewing_pre_edit_process_key(self->icPreEdit, IBUS_KEY_Up, 0);
     ibus_chewing_engine_update(self);
 }
@@ -692,6 +1074,8 @@ static void ibus_chewing_engine_cursor_down(IBusEngine *engine G_GNUC_UNUSED) {
 
     if (is_password(self))
         return;
+    ibus_chewing_engine_worker_sync(self);
+    ibus_chewing_engine_apply_settings(self);
     ibus_chewing_pre_edit_process_key(self->icPreEdit, IBUS_KEY_Down, 0);
     ibus_chewing_engine_update(self);
 }
@@ -729,15 +1113,21 @@ static void ibus_chewing_engine_property_hide(IBusEngine *engine G_GNUC_UNUSED,
  * beginning of reset, enable, and focus_in for setup.
  */
 void ibus_chewing_engine_start(IBusChewingEngine *self) {
-#ifndef UNIT_TEST
+    ibus_chewing_engine_apply_settings(self);
     if (!ibus_chewing_engine_has_status_flag(self, ENGINE_FLAG_PROPERTIES_REGISTERED)) {
         IBUS_ENGINE_GET_CLASS(self)->property_show(IBUS_ENGINE(self), "InputMode");
         IBUS_ENGINE_GET_CLASS(self)->property_show(IBUS_ENGINE(self), "AlnumSize");
         IBUS_ENGINE_GET_CLASS(self)->property_show(IBUS_ENGINE(self), "setup_prop");
+        /* Registered with the current labels, so the refresh below sends nothing */
+        ibus_chewing_engine_sync_property(self, quarkInputMode);
+        ibus_chewing_engine_sync_property(self, quarkAlnumSize);
+        ibus_chewing_engine_sync_property(self, quarkSetupProp);
+#ifndef UNIT_TEST
         ibus_engine_register_properties(IBUS_ENGINE(self), self->prop_list);
+#endif
         ibus_chewing_engine_set_status_flag(self, ENGINE_FLAG_PROPERTIES_REGISTERED);
+        self->lastPropsValid = TRUE;
     }
-#endif
     ibus_chewing_engine_restore_mode(self);
     ibus_chewing_engine_refresh_property_list(self);
 }
@@ -754,8 +1144,11 @@ void ibus_chewing_engine_reset(IBusEngine *engine) {
     IBusChewingEngine *self = IBUS_CHEWING_ENGINE(engine);
     IBUS_CHEWING_LOG(MSG, "* reset");
 
+    /* Text committed before the reset still goes out */
+    ibus_chewing_engine_flush_ui(self);
     /* Always clean buffer */
     ibus_chewing_pre_edit_clear(self->icPreEdit);
+    ibus_chewing_engine_invalidate_ui(self);
 #ifndef UNIT_TEST
 
     ibus_engine_hide_auxiliary_text(engine);
@@ -768,6 +1161,7 @@ void ibus_chewing_engine_reset(IBusEngine *engine) {
 void ibus_chewing_engine_enable(IBusEngine *engine) {
     IBusChewingEngine *self = IBUS_CHEWING_ENGINE(engine);
     IBUS_CHEWING_LOG(MSG, "* enable(): statusFlags=%x", self->statusFlags);
+    ibus_chewing_engine_worker_sync(self);
     ibus_chewing_engine_start(self);
     ibus_chewing_engine_set_status_flag(self, ENGINE_FLAG_ENABLED);
     if (self->prop_default_use_english_mode) {
@@ -778,18 +1172,31 @@ void ibus_chewing_engine_enable(IBusEngine *engine) {
 void ibus_chewing_engine_disable(IBusEngine *engine) {
     IBusChewingEngine *self = IBUS_CHEWING_ENGINE(engine);
     IBUS_CHEWING_LOG(MSG, "* disable(): statusFlags=%x", self->statusFlags);
+    ibus_chewing_engine_flush_ui(self);
     ibus_chewing_engine_clear_status_flag(self, ENGINE_FLAG_ENABLED);
 }
 
 void ibus_chewing_engine_focus_in(IBusEngine *engine) {
     IBusChewingEngine *self = IBUS_CHEWING_ENGINE(engine);
     IBUS_CHEWING_LOG(MSG, "* focus_in(): statusFlags=%x", self->statusFlags);
+    ibus_chewing_engine_flush_ui(self);
     ibus_chewing_engine_start(self);
-    /* Shouldn't have anything to commit when Focus-in */
-    ibus_chewing_pre_edit_clear(self->icPreEdit);
-    refresh_pre_edit_text(self);
-    refresh_aux_text(self);
-    refresh_outgoing_text(self);
+    /* Shouldn't have anything to commit when Focus-in.
+     * Focus often bounces with nothing typed in between, then there is
+     * nothing to clear either. */
+    if (!ibus_chewing_pre_edit_is_empty(self->icPreEdit) ||
+        !ibus_chewing_pre_edit_is_outgoing_empty(self->icPreEdit) ||
+        ibus_chewing_bopomofo_check(self->icPreEdit->context) ||
+        ibus_chewing_pre_edit_has_flag(self->icPreEdit, FLAG_TABLE_SHOW) ||
+        !ibus_text_is_empty(self->auxText)) {
+        ibus_chewing_pre_edit_clear(self->icPreEdit);
+        refresh_pre_edit_text(self);
+        refresh_aux_text(self);
+        refresh_outgoing_text(self);
+    } else {
+        self->stats.focusClearsSkipped++;
+    }
+    ibus_chewing_engine_invalidate_ui(self);
 
     ibus_chewing_engine_set_status_flag(self, ENGINE_FLAG_FOCUS_IN);
     IBUS_CHEWING_LOG(INFO, "focus_in() statusFlags=%x: return", self->statusFlags);
@@ -798,9 +1205,12 @@ void ibus_chewing_engine_focus_in(IBusEngine *engine) {
 void ibus_chewing_engine_focus_out(IBusEngine *engine) {
     IBusChewingEngine *self = IBUS_CHEWING_ENGINE(engine);
     IBUS_CHEWING_LOG(MSG, "* focus_out(): statusFlags=%x", self->statusFlags);
+    ibus_chewing_engine_flush_ui(self);
     ibus_chewing_engine_clear_status_flag(self,
                                           ENGINE_FLAG_FOCUS_IN | ENGINE_FLAG_PROPERTIES_REGISTERED);
+    self->lastPropsValid = FALSE;
     ibus_chewing_engine_hide_property_list(self);
+    ibus_chewing_engine_invalidate_ui(self);
 
     if (self->prop_clean_buffer_focus_out) {
         /* Clean the buffer when focus out */
@@ -808,6 +1218,7 @@ void ibus_chewing_engine_focus_out(IBusEngine *engine) {
         refresh_pre_edit_text(self);
         refresh_aux_text(self);
     }
+    ibus_chewing_engine_flush_learning(self);
 
     IBUS_CHEWING_LOG(DEBUG, "focus_out(): return");
 }
@@ -835,63 +1246,119 @@ void parent_commit_text(IBusEngine *iEngine) {
     IBusChewingEngine *self = IBUS_CHEWING_ENGINE(iEngine);
 
     IBUS_CHEWING_LOG(MSG, "* parent_commit_text(-): outgoingText=%s", self->outgoingText->text);
+    IBUS_CHEWING_TRACE(ui_entry, "commit_text");
 #ifdef UNIT_TEST
     printf("* parent_commit_text(-, %s)\n", self->outgoingText->text);
 #else
     ibus_engine_commit_text(iEngine, self->outgoingText);
 #endif
+    IBUS_CHEWING_TRACE(ui_return);
 }
 
 void parent_update_pre_edit_text([[maybe_unused]] IBusEngine *iEngine, IBusText *iText,
                                  guint cursor_pos, gboolean visible) {
+    IBUS_CHEWING_TRACE(ui_entry, "update_preedit_text");
 #ifdef UNIT_TEST
     printf("* parent_update_pre_edit_text(-, %s, %u, %x)\n", iText->text, cursor_pos, visible);
 #else
     ibus_engine_update_preedit_text(iEngine, iText, cursor_pos, visible);
 #endif
+    IBUS_CHEWING_TRACE(ui_return);
 }
 
 void parent_update_pre_edit_text_with_mode([[maybe_unused]] IBusEngine *iEngine, IBusText *iText,
                                            guint cursor_pos, gboolean visible,
                                            IBusPreeditFocusMode mode) {
+    IBUS_CHEWING_TRACE(ui_entry, "update_preedit_text_with_mode");
 #ifdef UNIT_TEST
     printf("* parent_update_pre_edit_text_with_mode(-, %s, %u, %x, %x)\n", iText->text, cursor_pos,
            visible, mode);
 #else
     ibus_engine_update_preedit_text_with_mode(iEngine, iText, cursor_pos, visible, mode);
 #endif
+    IBUS_CHEWING_TRACE(ui_return);
 }
 
 void parent_update_auxiliary_text([[maybe_unused]] IBusEngine *iEngine, IBusText *iText,
                                   gboolean visible) {
+    IBUS_CHEWING_TRACE(ui_entry, "update_auxiliary_text");
 #ifdef UNIT_TEST
     printf("* parent_update_auxiliary_text(-, %s, %x)\n", (iText) ? iText->text : "NULL", visible);
 #else
     if (!visible || ibus_text_is_empty(iText)) {
         ibus_engine_hide_auxiliary_text(iEngine);
-        return;
+    } else {
+        ibus_engine_update_auxiliary_text(iEngine, iText, visible);
+        ibus_engine_show_auxiliary_text(iEngine);
     }
-    ibus_engine_update_auxiliary_text(iEngine, iText, visible);
-    ibus_engine_show_auxiliary_text(iEngine);
 #endif
+    IBUS_CHEWING_TRACE(ui_return);
 }
 
-IBusText *decorate_pre_edit(IBusChewingPreEdit *icPreEdit,
-                            [[maybe_unused]] IBusCapabilite capabilite) {
+/*
+ * Point *iText at a text of str. A text may still be queued in a D-Bus message
+ * or held by IBus, so it is never changed; a new one is made when str differs.
+ */
+static void text_set(IBusChewingEngine *self, IBusText **iText, const gchar *str) {
+    if (STRING_IS_EMPTY(str)) {
+        g_set_object(iText, self->emptyText);
+    } else if (strcmp((*iText)->text, str) != 0) {
+        g_object_unref(*iText);
+        *iText = ui_object_created(self, g_object_ref_sink(ibus_text_new_from_string(str)));
+    }
+}
+
+/* Immutable text of a static string, shared by all its uses */
+static IBusText *static_text(IBusChewingEngine *self, const gchar *str) {
+    IBusText *iText = g_hash_table_lookup(self->staticTexts, str);
+
+    if (iText == NULL) {
+        iText = ui_object_created(self, g_object_ref_sink(ibus_text_new_from_static_string(str)));
+        g_hash_table_insert(self->staticTexts, (gpointer)str, iText);
+    }
+    return iText;
+}
+
+/* Immutable "(i/N)" page label */
+static IBusText *page_text(IBusChewingEngine *self, guint currentPage, guint totalPage) {
+    gpointer key = GUINT_TO_POINTER(currentPage << 16 | (totalPage & 0xffff));
+    IBusText *iText = g_hash_table_lookup(self->pageTexts, key);
+
+    if (iText == NULL) {
+        if (g_hash_table_size(self->pageTexts) >= PAGE_TEXTS_MAX) {
+            g_hash_table_remove_all(self->pageTexts);
+        }
+        iText = ui_object_created(
+            self, g_object_ref_sink(ibus_text_new_from_printf("(%u/%u)", currentPage, totalPage)));
+        g_hash_table_insert(self->pageTexts, key, iText);
+    }
+    return iText;
+}
+
+/* The pre-edit with its underline and cursor, always a new text */
+IBusText *decorate_pre_edit(IBusChewingEngine *self) {
+    IBusChewingPreEdit *icPreEdit = self->icPreEdit;
     gchar *preEdit = ibus_chewing_pre_edit_get_pre_edit(icPreEdit);
-    IBusText *iText = ibus_text_new_from_string(preEdit);
     gint chiSymbolCursor = chewing_cursor_Current(icPreEdit->context);
-    gint charLen = (gint)g_utf8_strlen(preEdit, -1);
+    gint charLen = (gint)ibus_chewing_pre_edit_word_length(icPreEdit);
 
     IBUS_CHEWING_LOG(DEBUG,
                      "decorate_pre_edit() cursor=%d "
                      "preEdit=%s charLen=%d",
                      chiSymbolCursor, preEdit, charLen);
 
+    if (STRING_IS_EMPTY(preEdit)) {
+        return g_object_ref(self->emptyText);
+    }
+    IBusText *iText =
+        ui_object_created(self, g_object_ref_sink(ibus_text_new_from_string(preEdit)));
+
     /* Use single underline to mark whole pre-edit buffer
      */
     ibus_text_append_attribute(iText, IBUS_ATTR_TYPE_UNDERLINE, IBUS_ATTR_UNDERLINE_SINGLE, 0,
                                charLen);
+    /* The attribute list and the underline */
+    self->stats.objectsCreated += 2;
 
     /* Use background color to show current cursor */
     if (chiSymbolCursor < charLen) {
@@ -899,96 +1366,135 @@ IBusText *decorate_pre_edit(IBusChewingPreEdit *icPreEdit,
                                    chiSymbolCursor + 1);
         ibus_text_append_attribute(iText, IBUS_ATTR_TYPE_FOREGROUND, 0x00000000, chiSymbolCursor,
                                    chiSymbolCursor + 1);
+        self->stats.objectsCreated += 2;
     }
-
     return iText;
 }
 
 void refresh_pre_edit_text(IBusChewingEngine *self) {
-    IBusText *iText = decorate_pre_edit(self->icPreEdit, self->capabilite);
+    IBusText *iText = decorate_pre_edit(self);
+
+    g_object_unref(self->preEditText);
+    self->preEditText = iText;
+}
+
+/*
+ * Record text, cursor and visibility about to be sent on a surface.
+ * Returns FALSE if IBus already shows exactly that.
+ */
+static gboolean sent_text_changed(IBusChewingSentText *sent, const gchar *text, guint cursor,
+                                  gboolean visible) {
+    guint hash = g_str_hash(text);
 
-    if (self->preEditText) {
-        g_object_unref(self->preEditText);
+    if (sent->valid && sent->hash == hash && sent->cursor == cursor && sent->visible == visible &&
+        strcmp(sent->text->str, text) == 0) {
+        return FALSE;
     }
-    self->preEditText = g_object_ref_sink(iText);
+    sent->valid = TRUE;
+    sent->hash = hash;
+    g_string_assign(sent->text, text);
+    sent->cursor = cursor;
+    sent->visible = visible;
+    return TRUE;
 }
 
 void update_pre_edit_text(IBusChewingEngine *self) {
-    refresh_pre_edit_text(self);
-    gboolean visible = TRUE;
-    gint bpmfLen = self->icPreEdit->bpmfLen;
+    const gchar *preEdit = ibus_chewing_pre_edit_get_pre_edit(self->icPreEdit);
+    guint cursor = chewing_cursor_Current(self->icPreEdit->context) + self->icPreEdit->bpmfLen;
+    gboolean visible = !STRING_IS_EMPTY(preEdit);
 
-    IBusPreeditFocusMode mode;
-
-    if (STRING_IS_EMPTY(self->preEditText->text)) {
-        mode = IBUS_ENGINE_PREEDIT_CLEAR;
-        visible = FALSE;
-    } else {
-        mode = IBUS_ENGINE_PREEDIT_COMMIT;
+    if (!sent_text_changed(&self->lastPreEdit, preEdit, cursor, visible)) {
+        IBUS_CHEWING_LOG(DEBUG, "update_pre_edit_text() unchanged");
+        ui_update_saved(self);
+        return;
     }
+    refresh_pre_edit_text(self);
+
+    IBusPreeditFocusMode mode = visible ? IBUS_ENGINE_PREEDIT_COMMIT : IBUS_ENGINE_PREEDIT_CLEAR;
 
-    parent_update_pre_edit_text_with_mode(
-        IBUS_ENGINE(self), self->preEditText,
-        chewing_cursor_Current(self->icPreEdit->context) + bpmfLen, visible, mode);
+    parent_update_pre_edit_text_with_mode(IBUS_ENGINE(self), self->preEditText, cursor, visible,
+                                          mode);
+    ui_update_sent(self);
 }
 
 void refresh_aux_text(IBusChewingEngine *self) {
     IBUS_CHEWING_LOG(INFO, "refresh_aux_text()");
 
-    if (self->auxText != NULL) {
-        g_object_unref(self->auxText);
-    }
-
     /* Make auxText (text to be displayed in auxiliary
      * candidate window). Use auxText to show messages
      * from libchewing, such as "已有：".
      */
+    IBusText *iText;
 
     gboolean showPageNumber = self->prop_show_page_number;
 
     if (chewing_aux_Length(self->icPreEdit->context) > 0) {
         IBUS_CHEWING_LOG(INFO, "update_aux_text() chewing_aux_Length=%x",
                          chewing_aux_Length(self->icPreEdit->context));
-        gchar *auxStr = chewing_aux_String(self->icPreEdit->context);
+        const gchar *auxStr = chewing_aux_String_static(self->icPreEdit->context);
 
         IBUS_CHEWING_LOG(INFO, "update_aux_text() auxStr=%s", auxStr);
-        self->auxText = g_object_ref_sink(ibus_text_new_from_string(auxStr));
-        chewing_free(auxStr);
+        text_set(self, &self->auxText, auxStr);
+        return;
     } else if (self->prop_notify_mode_change && self->pending_notify_chinese_english_mode) {
         self->pending_notify_chinese_english_mode = FALSE;
-        char *auxStr = is_chinese_mode(self) ? _("Chinese Mode") : _("English Mode");
-        self->auxText = g_object_ref_sink(ibus_text_new_from_static_string(auxStr));
+        iText = static_text(self, is_chinese_mode(self) ? _("Chinese Mode") : _("English Mode"));
     } else if (self->prop_notify_mode_change && self->pending_notify_fullwidth_mode) {
         self->pending_notify_fullwidth_mode = FALSE;
-        char *auxStr = is_fullwidth_mode(self) ? _("Fullwidth Mode") : _("Halfwidth Mode");
-        self->auxText = g_object_ref_sink(ibus_text_new_from_static_string(auxStr));
-    } else if (showPageNumber && (chewing_cand_TotalPage(self->icPreEdit->context) > 0)) {
-        int TotalPage = chewing_cand_TotalPage(self->icPreEdit->context);
-        int currentPage = chewing_cand_CurrentPage(self->icPreEdit->context) + 1;
-        self->auxText =
-            g_object_ref_sink(ibus_text_new_from_printf("(%i/%i)", currentPage, TotalPage));
+        iText =
+            static_text(self, is_fullwidth_mode(self) ? _("Fullwidth Mode") : _("Halfwidth Mode"));
+    } else if (showPageNumber &&
+               ibus_chewing_pre_edit_has_flag(self->icPreEdit, FLAG_TABLE_SHOW)) {
+        /* The page shown, which libchewing only follows on selection */
+        int TotalPage = ibus_chewing_lookup_table_get_total_pages(self->icPreEdit->iTable);
+        int currentPage = ibus_chewing_lookup_table_get_page(self->icPreEdit->iTable) + 1;
+        iText = page_text(self, currentPage, TotalPage);
     } else {
         /* clear out auxText, otherwise it will be
          * displayed continually. */
-        self->auxText = g_object_ref_sink(ibus_text_new_from_static_string(""));
+        iText = self->emptyText;
     }
+    g_set_object(&self->auxText, iText);
 }
 
 void update_aux_text(IBusChewingEngine *self) {
     IBUS_CHEWING_LOG(DEBUG, "update_aux_text()");
     refresh_aux_text(self);
+    if (!sent_text_changed(&self->lastAux, self->auxText->text, 0, TRUE)) {
+        IBUS_CHEWING_LOG(DEBUG, "update_aux_text() unchanged");
+        ui_update_saved(self);
+        return;
+    }
     parent_update_auxiliary_text(IBUS_ENGINE(self), self->auxText, TRUE);
+    ui_update_sent(self);
 }
 
 void update_lookup_table(IBusChewingEngine *self) {
-    IBUS_CHEWING_LOG(DEBUG, "update_lookup_table() CurrentPage=%d",
-                     chewing_cand_CurrentPage(self->icPreEdit->context));
+    IBUS_CHEWING_LOG(DEBUG, "update_lookup_table() page=%u",
+                     ibus_chewing_lookup_table_get_page(self->icPreEdit->iTable));
 
     gboolean isShow = ibus_chewing_pre_edit_has_flag(self->icPreEdit, FLAG_TABLE_SHOW);
+    guint generation = self->icPreEdit->tableGeneration;
+    guint cursor = ibus_lookup_table_get_cursor_pos(self->icPreEdit->iTable);
+
+    /* A hidden table stays hidden; a shown one only needs resending if it changed */
+    if (self->lastTableValid && self->lastTableShow == isShow &&
+        (!isShow || (self->lastTableGeneration == generation && self->lastTableCursor == cursor))) {
+        IBUS_CHEWING_LOG(DEBUG, "update_lookup_table() unchanged");
+        ui_update_saved(self);
+        return;
+    }
+    self->lastTableValid = TRUE;
+    self->lastTableShow = isShow;
+    self->lastTableGeneration = generation;
+    self->lastTableCursor = cursor;
+    ui_update_sent(self);
 
+    IBUS_CHEWING_TRACE(ui_entry, "update_lookup_table");
     if (isShow) {
 #ifndef UNIT_TEST
-        ibus_engine_update_lookup_table(IBUS_ENGINE(self), self->icPreEdit->iTable, isShow);
+        /* iTable holds the whole list, send the pages around the cursor */
+        ibus_engine_update_lookup_table_fast(IBUS_ENGINE(self), self->icPreEdit->iTable, isShow);
         ibus_engine_show_lookup_table(IBUS_ENGINE(self));
 #endif
     } else {
@@ -997,6 +1503,7 @@ void update_lookup_table(IBusChewingEngine *self) {
         ibus_engine_hide_lookup_table(IBUS_ENGINE(self));
 #endif
     }
+    IBUS_CHEWING_TRACE(ui_return);
 }
 
 void refresh_outgoing_text(IBusChewingEngine *self) {
@@ -1004,44 +1511,306 @@ void refresh_outgoing_text(IBusChewingEngine *self) {
 
     IBUS_CHEWING_LOG(INFO, "refresh_outgoing_text() outgoingStr=|%s|", outgoingStr);
 
-    if (self->outgoingText) {
-        g_object_unref(self->outgoingText);
-    }
-    self->outgoingText = g_object_ref_sink(ibus_text_new_from_string(outgoingStr));
+    text_set(self, &self->outgoingText, outgoingStr);
     IBUS_CHEWING_LOG(DEBUG, "refresh_outgoing_text() outgoingText=|%s|", self->outgoingText->text);
 }
 
 void commit_text(IBusChewingEngine *self) {
-    refresh_outgoing_text(self);
-    if (!ibus_text_is_empty(self->outgoingText) ||
-        !ibus_chewing_engine_has_status_flag(self, ENGINE_FLAG_FOCUS_IN)) {
-        parent_commit_text(IBUS_ENGINE(self));
+    if (ibus_chewing_pre_edit_is_outgoing_empty(self->icPreEdit)) {
+        /* Nothing to commit, only keep outgoingText in sync */
+        if (!ibus_text_is_empty(self->outgoingText)) {
+            refresh_outgoing_text(self);
+        }
+        ui_update_saved(self);
+        return;
     }
+    refresh_outgoing_text(self);
+    parent_commit_text(IBUS_ENGINE(self));
+    ui_update_sent(self);
 
     ibus_chewing_pre_edit_clear_outgoing(self->icPreEdit);
 }
 
+/*===================================================
+ * Worker thread
+ *
+ * With worker-thread on, key events that need libchewing are queued to a
+ * thread that owns icPreEdit until it has answered them all. Each answer
+ * carries the text the key committed, so commits reach the client in key
+ * order. The main loop waits worker-key-timeout for an answer; a key that
+ * takes longer is reported as handled and forwarded later if it was not.
+ */
+typedef struct {
+    KSym keySym;
+    guint keyCode;
+    KeyModifiers unmaskedMod;
+    /* Set by the worker */
+    KSym kSym;
+    gboolean result;
+    gchar *commit;
+    gboolean done;
+    /* Already reported as handled to IBus */
+    gboolean late;
+    /* Not a key: learn the phrases deferred-learning queued */
+    gboolean learn;
+    guint learned;
+} IBusChewingWorkerKey;
+
+/* Pushed to stop the worker */
+static IBusChewingWorkerKey workerStop;
+
+static void worker_key_free(IBusChewingWorkerKey *key) {
+    g_free(key->commit);
+    g_free(key);
+}
+
+static gboolean worker_results_idle(gpointer user_data);
+
+static gpointer worker_thread(gpointer user_data) {
+    IBusChewingEngine *self = IBUS_CHEWING_ENGINE(user_data);
+    IBusChewingWorkerKey *key;
+
+    while ((key = g_async_queue_pop(self->workerQueue)) != &workerStop) {
+        if (key->learn) {
+            key->learned = ibus_chewing_pre_edit_learn_flush(self->icPreEdit);
+        } else {
+            key->kSym = ibus_chewing_pre_edit_key_code_to_key_sym(self->icPreEdit, key->keySym,
+                                                                  key->keyCode, key->unmaskedMod);
+            key->result = ibus_chewing_pre_edit_process_key(self->icPreEdit, key->kSym,
+                                                            key->unmaskedMod);
+            key->commit = g_strdup(ibus_chewing_pre_edit_get_outgoing(self->icPreEdit));
+            ibus_chewing_pre_edit_clear_outgoing(self->icPreEdit);
+        }
+
+        g_mutex_lock(&self->workerLock);
+        key->done = TRUE;
+        g_cond_broadcast(&self->workerCond);
+        g_mutex_unlock(&self->workerLock);
+        g_idle_add_full(G_PRIORITY_HIGH, worker_results_idle, g_object_ref(self), g_object_unref);
+    }
+    return NULL;
+}
+
+static void ibus_chewing_engine_worker_start(IBusChewingEngine *self) {
+    if (self->worker != NULL) {
+        return;
+    }
+    self->workerQueue = g_async_queue_new();
+    self->worker = g_thread_new("chewing-worker", worker_thread, self);
+}
+
+static void ibus_chewing_engine_worker_stop(IBusChewingEngine *self) {
+    if (self->worker == NULL) {
+        return;
+    }
+    ibus_chewing_engine_worker_sync(self);
+    g_async_queue_push(self->workerQueue, &workerStop);
+    g_thread_join(self->worker);
+    self->worker = NULL;
+    g_clear_pointer(&self->workerQueue, g_async_queue_unref);
+}
+
+/* Commit, and forward if late and unused, the answered keys at the head of workerKeys.
+ * Returns TRUE if the worker has no key left. */
+static gboolean worker_collect(IBusChewingEngine *self) {
+    IBusChewingWorkerKey *key;
+
+    while ((key = g_queue_peek_head(&self->workerKeys)) != NULL) {
+        g_mutex_lock(&self->workerLock);
+        gboolean done = key->done;
+        g_mutex_unlock(&self->workerLock);
+
+        if (!done) {
+            return FALSE;
+        }
+        g_queue_pop_head(&self->workerKeys);
+        self->stats.phrasesLearned += key->learned;
+        if (!STRING_IS_EMPTY(key->commit)) {
+            text_set(self, &self->outgoingText, key->commit);
+            parent_commit_text(IBUS_ENGINE(self));
+            ui_update_sent(self);
+        }
+        if (key->late) {
+            self->workerUiBehind = TRUE;
+            if (!key->result) {
+#ifndef UNIT_TEST
+                ibus_engine_forward_key_event(IBUS_ENGINE(self), key->keySym, key->keyCode,
+                                              key->unmaskedMod);
+#endif
+            }
+            if (key->kSym == IBUS_KEY_Shift_L || key->kSym == IBUS_KEY_Shift_R ||
+                key->kSym == IBUS_KEY_Caps_Lock) {
+                self->workerRefreshProperties = TRUE;
+            }
+        }
+        worker_key_free(key);
+        g_object_unref(self);
+    }
+    return TRUE;
+}
+
+static gboolean worker_results_idle(gpointer user_data) {
+    IBusChewingEngine *self = IBUS_CHEWING_ENGINE(user_data);
+
+    if (!worker_collect(self) || !self->workerUiBehind) {
+        return G_SOURCE_REMOVE;
+    }
+    /* The worker is idle, show where the late keys left it */
+    self->workerUiBehind = FALSE;
+    ibus_chewing_engine_update(self);
+    if (self->workerRefreshProperties) {
+        self->workerRefreshProperties = FALSE;
+        ibus_chewing_engine_refresh_property_list(self);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * ibus_chewing_engine_worker_sync:
+ * @self: IBusChewingEngine instance.
+ *
+ * Wait until the worker thread has answered every key, and commit what they
+ * produced. icPreEdit belongs to the main loop again afterwards.
+ * Unlike key processing, this wait has no limit; worker-key-timeout does
+ * not apply to it.
+ */
+void ibus_chewing_engine_worker_sync(IBusChewingEngine *self) {
+    IBusChewingWorkerKey *last = g_queue_peek_tail(&self->workerKeys);
+
+    if (last == NULL) {
+        return;
+    }
+    g_mutex_lock(&self->workerLock);
+    while (!last->done) {
+        g_cond_wait(&self->workerCond, &self->workerLock);
+    }
+    g_mutex_unlock(&self->workerLock);
+    worker_collect(self);
+}
+
+/* Queue a learning flush behind the keys the worker has, without waiting for it */
+static void worker_learn(IBusChewingEngine *self) {
+    IBusChewingWorkerKey *key = g_new0(IBusChewingWorkerKey, 1);
+
+    key->learn = TRUE;
+    g_object_ref(self);
+    g_queue_push_tail(&self->workerKeys, key);
+    g_async_queue_push(self->workerQueue, key);
+}
+
+/* Queue the key to the worker, and wait at most worker-key-timeout for the result.
+ * Returns FALSE if the key is still with the worker. */
+static gboolean worker_process_key_event(IBusChewingEngine *self, KSym keySym, guint keycode,
+                                         KeyModifiers unmaskedMod, KSym *kSym,
+                                         gboolean *result) {
+    IBusChewingWorkerKey *key = g_new0(IBusChewingWorkerKey, 1);
+    gint64 deadline =
+        g_get_monotonic_time() + self->prop_worker_key_timeout * G_TIME_SPAN_MILLISECOND;
+
+    key->keySym = keySym;
+    key->keyCode = keycode;
+    key->unmaskedMod = unmaskedMod;
+    /* Keep the engine, and so the worker, alive until the key is collected */
+    g_object_ref(self);
+    g_queue_push_tail(&self->workerKeys, key);
+    g_async_queue_push(self->workerQueue, key);
+
+    g_mutex_lock(&self->workerLock);
+    while (!key->done && g_cond_wait_until(&self->workerCond, &self->workerLock, deadline)) {
+    }
+    gboolean done = key->done;
+    key->late = !done;
+    g_mutex_unlock(&self->workerLock);
+
+    if (!done) {
+        IBUS_CHEWING_LOG(INFO, "process_key_event() %x late, reported as handled", keySym);
+        self->stats.keysLate++;
+        return FALSE;
+    }
+    /* Keys are answered in order, so the worker is idle now */
+    *kSym = key->kSym;
+    *result = key->result;
+    worker_collect(self);
+    return TRUE;
+}
+
 gboolean ibus_chewing_engine_process_key_event(IBusEngine *engine, KSym keySym, guint keycode,
                                                KeyModifiers unmaskedMod) {
-    IBUS_CHEWING_LOG(MSG, "******** process_key_event(-,%x(%s),%x,%x) %s", keySym,
-                     key_sym_get_name(keySym), keycode, unmaskedMod,
-                     modifiers_to_string(unmaskedMod));
-
     IBusChewingEngine *self = IBUS_CHEWING_ENGINE(engine);
 
-    if (unmaskedMod & IBUS_MOD4_MASK)
+    IBUS_CHEWING_TRACE(key_entry, keySym, keycode, unmaskedMod);
+    track_caps_lock(self, keySym, unmaskedMod);
+    if ((unmaskedMod & IBUS_MOD4_MASK) || is_password(self)) {
+        IBUS_CHEWING_TRACE(key_return, FALSE);
         return FALSE;
+    }
 
-    if (is_password(self))
+    /* Keys behind those the worker still has queue behind them */
+    gboolean workerBusy = self->worker != NULL && !worker_collect(self);
+
+    /* English sub-mode with nothing to edit: nothing to translate, process or send */
+    if (!workerBusy && ibus_chewing_pre_edit_pass_through(self->icPreEdit, keySym, unmaskedMod)) {
+        self->stats.keysPassedThrough++;
+        /* The client inserts the key after anything still to be committed */
+        ibus_chewing_engine_flush_ui(self);
+        IBUS_CHEWING_TRACE(key_return, FALSE);
         return FALSE;
+    }
+
+    /* Releases only feed the Shift toggle, leave the UI alone */
+    if (!workerBusy && (unmaskedMod & IBUS_RELEASE_MASK)) {
+        EventResponse response =
+            ibus_chewing_pre_edit_process_release(self->icPreEdit, keySym, unmaskedMod);
+
+        if (response != EVENT_RESPONSE_UNDECIDED) {
+            self->stats.releasesShortCircuited++;
+            if (response != EVENT_RESPONSE_ABSORB) {
+                /* The client gets the release after anything still to be committed */
+                ibus_chewing_engine_flush_ui(self);
+            }
+            IBUS_CHEWING_TRACE(key_return, response == EVENT_RESPONSE_ABSORB);
+            return response == EVENT_RESPONSE_ABSORB;
+        }
+    }
+
+    IBUS_CHEWING_LOG(MSG, "******** process_key_event(-,%x(%s),%x,%x) %s", keySym,
+                     key_sym_get_name(keySym), keycode, unmaskedMod,
+                     modifiers_to_string(unmaskedMod));
+
+    KSym kSym;
+    gboolean result;
 
-    KSym kSym =
-        ibus_chewing_pre_edit_key_code_to_key_sym(self->icPreEdit, keySym, keycode, unmaskedMod);
+    /* libchewing is ours while the worker is idle; otherwise apply_settings_idle() catches up */
+    if (!workerBusy) {
+        ibus_chewing_engine_apply_settings(self);
+    }
+    if (self->worker != NULL) {
+        if (!worker_process_key_event(self, keySym, keycode, unmaskedMod, &kSym, &result)) {
+            /* The UI catches up when the worker answers */
+            IBUS_CHEWING_TRACE(key_return, TRUE);
+            return TRUE;
+        }
+    } else {
+        IBUS_CHEWING_TRACE(keysym_entry, keySym, keycode);
+        kSym = ibus_chewing_pre_edit_key_code_to_key_sym(self->icPreEdit, keySym, keycode,
+                                                         unmaskedMod);
+        IBUS_CHEWING_TRACE(keysym_return, kSym);
 
-    gboolean result = ibus_chewing_pre_edit_process_key(self->icPreEdit, kSym, unmaskedMod);
+        result = ibus_chewing_pre_edit_process_key(self->icPreEdit, kSym, unmaskedMod);
+    }
 
     IBUS_CHEWING_LOG(MSG, "process_key_event() result=%d", result);
-    ibus_chewing_engine_update(self);
+    IBusChewingEngineStats before = self->stats;
+    if (self->prop_coalesce_ui_updates && result) {
+        ibus_chewing_engine_defer_update(self);
+    } else {
+        /* An unconsumed key must reach the client after the commits before it */
+        ibus_chewing_engine_update(self);
+    }
+    IBUS_CHEWING_LOG(INFO, "process_key_event() UI updates sent=%" G_GUINT64_FORMAT
+                     " saved=%" G_GUINT64_FORMAT,
+                     self->stats.updatesSent - before.updatesSent,
+                     self->stats.updatesSaved - before.updatesSaved);
 
     if (kSym == IBUS_KEY_Shift_L || kSym == IBUS_KEY_Shift_R || kSym == IBUS_KEY_Caps_Lock) {
         /* Refresh property list (language bar) only when
@@ -1053,6 +1822,7 @@ gboolean ibus_chewing_engine_process_key_event(IBusEngine *engine, KSym keySym,
         ibus_chewing_engine_refresh_property_list(self);
     }
 
+    IBUS_CHEWING_TRACE(key_return, result);
     return result;
 }
 
@@ -1067,59 +1837,131 @@ void ibus_chewing_engine_candidate_clicked(IBusEngine *engine, guint index, guin
 
     if (is_password(self))
         return;
+    ibus_chewing_engine_worker_sync(self);
     if ((gint)index >= chewing_get_candPerPage(self->icPreEdit->context)) {
         IBUS_CHEWING_LOG(DEBUG, "candidate_clicked() index out of ranged");
         return;
     }
     if (ibus_chewing_pre_edit_has_flag(self->icPreEdit, FLAG_TABLE_SHOW)) {
-        gint *selKeys = chewing_get_selKey(self->icPreEdit->context);
-        KSym k = (KSym)selKeys[index];
+        KSym k = (KSym)self->icPreEdit->selKeys[index];
 
+        ibus_chewing_engine_apply_settings(self);
         ibus_chewing_pre_edit_process_key(self->icPreEdit, k, 0);
-        chewing_free(selKeys);
         ibus_chewing_engine_update(self);
     } else {
         IBUS_CHEWING_LOG(DEBUG, "candidate_clicked() ... candidates are not showing");
     }
 }
 
+/*=================================================
+ * Preferences window
+ *
+ * ibus-setup-chewing runs as a child process, so that the engine keeps
+ * handling keys while it is open.
+ */
+#define SETUP_PROGRAM QUOTE_ME(LIBEXEC_DIR) "/ibus-setup-chewing"
+#define SETUP_APPLICATION_ID "org.freedesktop.IBus.Chewing.Setup"
+#define SETUP_OBJECT_PATH "/org/freedesktop/IBus/Chewing/Setup"
+
+/* Running ibus-setup-chewing, shared by the engines of this process */
+static GSubprocess *setupProcess = NULL;
+
+static void setup_process_exited(GObject *source, GAsyncResult *res,
+                                 [[maybe_unused]] gpointer user_data) {
+    GSubprocess *process = G_SUBPROCESS(source);
+    g_autoptr(GError) error = NULL;
+
+    if (!g_subprocess_wait_finish(process, res, &error)) {
+        IBUS_CHEWING_LOG(WARN, "setup_process_exited(): %s", error->message);
+    }
+    IBUS_CHEWING_LOG(INFO, "setup_process_exited(): status=%d",
+                     g_subprocess_get_exit_status(process));
+    if (setupProcess == process) {
+        g_clear_object(&setupProcess);
+    }
+}
+
+static void setup_activated(GObject *source, GAsyncResult *res,
+                            [[maybe_unused]] gpointer user_data) {
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GVariant) ret =
+        g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+
+    if (ret == NULL) {
+        IBUS_CHEWING_LOG(WARN, "setup_activated(): %s", error->message);
+    }
+}
+
+static void setup_bus_ready([[maybe_unused]] GObject *source, GAsyncResult *res,
+                            [[maybe_unused]] gpointer user_data) {
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GDBusConnection) bus = g_bus_get_finish(res, &error);
+
+    if (bus == NULL) {
+        IBUS_CHEWING_LOG(WARN, "setup_bus_ready(): %s", error->message);
+        return;
+    }
+    /* ibus-setup-chewing is a GApplication, activating it presents its window */
+    g_dbus_connection_call(bus, SETUP_APPLICATION_ID, SETUP_OBJECT_PATH,
+                           "org.freedesktop.Application", "Activate",
+                           g_variant_new("(a{sv})", NULL), NULL, G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                           -1, NULL, setup_activated, NULL);
+}
+
+/**
+ * ibus_chewing_engine_show_setup:
+ *
+ * Open the preferences window without waiting for it to close,
+ * or bring it to front if it is already open.
+ */
+static void ibus_chewing_engine_show_setup() {
+    g_autoptr(GError) error = NULL;
+
+    if (setupProcess != NULL) {
+        IBUS_CHEWING_LOG(INFO, "show_setup(): already running, activate it");
+        g_bus_get(G_BUS_TYPE_SESSION, NULL, setup_bus_ready, NULL);
+        return;
+    }
+    setupProcess = g_subprocess_new(G_SUBPROCESS_FLAGS_NONE, &error, SETUP_PROGRAM, NULL);
+    if (setupProcess == NULL) {
+        IBUS_CHEWING_LOG(WARN, "show_setup(): cannot run %s: %s", SETUP_PROGRAM, error->message);
+        return;
+    }
+    g_subprocess_wait_async(setupProcess, NULL, setup_process_exited, NULL);
+}
+
 void ibus_chewing_engine_property_activate(IBusEngine *engine, const gchar *prop_name,
                                            guint prop_state) {
     IBUS_CHEWING_LOG(INFO, "property_activate(-, %s, %u)", prop_name, prop_state);
     IBusChewingEngine *self = IBUS_CHEWING_ENGINE(engine);
+    GQuark quark = g_quark_try_string(prop_name);
 
-    if (STRING_EQUALS(prop_name, "InputMode")) {
+    ibus_chewing_engine_worker_sync(self);
+    if (quark == quarkInputMode) {
         /* Toggle Chinese <-> English */
         ibus_chewing_pre_edit_toggle_chi_eng_mode(self->icPreEdit);
         IBUS_CHEWING_LOG(INFO, "property_activate chinese=%d", is_chinese_mode(self));
         ibus_chewing_engine_refresh_property(self, prop_name);
-    } else if (STRING_EQUALS(prop_name, "AlnumSize")) {
+    } else if (quark == quarkAlnumSize) {
         /* Toggle Full <-> Half */
         ibus_chewing_pre_edit_toggle_full_half_mode(self->icPreEdit);
         IBUS_CHEWING_LOG(INFO, "property_activate fullwidth=%d", is_fullwidth_mode(self));
         ibus_chewing_engine_refresh_property(self, prop_name);
-    } else if (STRING_EQUALS(prop_name, "setup_prop")) {
+    } else if (quark == quarkSetupProp) {
         /* open preferences window */
-        system(QUOTE_ME(LIBEXEC_DIR) "/ibus-setup-chewing");
+        ibus_chewing_engine_show_setup();
     } else {
         IBUS_CHEWING_LOG(DEBUG, "property_activate(-, %s, %u) not recognized", prop_name,
                          prop_state);
     }
 }
 
-char ibus_chewing_engine_get_default_english_case(IBusChewingEngine *self) {
-    char *prop = self->prop_default_english_case;
-    return STRING_EQUALS(prop, "lowercase") ? 'l' : STRING_EQUALS(prop, "uppercase") ? 'u' : 'n';
+EnglishCase ibus_chewing_engine_get_default_english_case(IBusChewingEngine *self) {
+    return self->defaultEnglishCase;
 }
 
-char ibus_chewing_engine_get_chinese_english_toggle_key(IBusChewingEngine *self) {
-    char *prop = self->prop_chi_eng_mode_toggle;
-    return STRING_EQUALS(prop, "caps_lock") ? 'c'
-           : STRING_EQUALS(prop, "shift")   ? 's'
-           : STRING_EQUALS(prop, "shift_l") ? 'l'
-           : STRING_EQUALS(prop, "shift_r") ? 'r'
-                                            : 'n';
-    return 'n';
+ChiEngToggle ibus_chewing_engine_get_chinese_english_toggle_key(IBusChewingEngine *self) {
+    return self->chiEngModeToggle;
 }
 
 gboolean ibus_chewing_engine_use_vertical_lookup_table(IBusChewingEngine *self) {
@@ -35,11 +35,76 @@ typedef enum {
     ENGINE_FLAG_ENABLED = 0x2,
     ENGINE_FLAG_FOCUS_IN = 0x4,
     ENGINE_FLAG_IS_PASSWORD = 0x8,
-    ENGINE_FLAG_PROPERTIES_REGISTERED = 0x10
+    ENGINE_FLAG_PROPERTIES_REGISTERED = 0x10,
+    ENGINE_FLAG_CAPS_LOCK_KNOWN = 0x20,
+    ENGINE_FLAG_CAPS_LOCK = 0x40
 } EngineFlag;
 #define ENGINE_TYPE_FLAG engine_flag_get_type()
 GType engine_flag_get_type(void) G_GNUC_CONST;
 
+/**
+ * ChiEngToggle:
+ * @CHI_ENG_TOGGLE_DISABLE: No key toggles Chinese/English mode.
+ * @CHI_ENG_TOGGLE_CAPS_LOCK: Caps Lock toggles.
+ * @CHI_ENG_TOGGLE_SHIFT: Either Shift toggles.
+ * @CHI_ENG_TOGGLE_SHIFT_L: Left Shift toggles.
+ * @CHI_ENG_TOGGLE_SHIFT_R: Right Shift toggles.
+ *
+ * Decoded value of the chi-eng-mode-toggle setting.
+ */
+typedef enum {
+    CHI_ENG_TOGGLE_DISABLE,
+    CHI_ENG_TOGGLE_CAPS_LOCK,
+    CHI_ENG_TOGGLE_SHIFT,
+    CHI_ENG_TOGGLE_SHIFT_L,
+    CHI_ENG_TOGGLE_SHIFT_R
+} ChiEngToggle;
+
+/**
+ * EnglishCase:
+ * @ENGLISH_CASE_NO_DEFAULT: Follow Caps Lock.
+ * @ENGLISH_CASE_LOWERCASE: Lowercase unless Shift is held.
+ * @ENGLISH_CASE_UPPERCASE: Uppercase unless Shift is held.
+ *
+ * Decoded value of the default-english-case setting.
+ */
+typedef enum {
+    ENGLISH_CASE_NO_DEFAULT,
+    ENGLISH_CASE_LOWERCASE,
+    ENGLISH_CASE_UPPERCASE
+} EnglishCase;
+
+/**
+ * SyncCapsLock:
+ * @SYNC_CAPS_LOCK_DISABLE: Do not sync.
+ * @SYNC_CAPS_LOCK_KEYBOARD: Sync the Chinese mode from the Caps Lock state.
+ * @SYNC_CAPS_LOCK_INPUT_METHOD: Sync the Caps Lock state from the Chinese mode.
+ *
+ * Decoded value of the sync-caps-lock setting.
+ */
+typedef enum {
+    SYNC_CAPS_LOCK_DISABLE,
+    SYNC_CAPS_LOCK_KEYBOARD,
+    SYNC_CAPS_LOCK_INPUT_METHOD
+} SyncCapsLock;
+
+/**
+ * ConversionEngine:
+ * @CONVERSION_ENGINE_INVALID: Unknown value, libchewing is left as is.
+ * @CONVERSION_ENGINE_SIMPLE: No phrase conversion.
+ * @CONVERSION_ENGINE_CHEWING: Intelligent phrase conversion.
+ * @CONVERSION_ENGINE_FUZZY_CHEWING: Intelligent conversion with fuzzy matching.
+ *
+ * Decoded value of the conversion-engine setting,
+ * the values match libchewing's chewing.conversion_engine.
+ */
+typedef enum {
+    CONVERSION_ENGINE_INVALID = -1,
+    CONVERSION_ENGINE_SIMPLE,
+    CONVERSION_ENGINE_CHEWING,
+    CONVERSION_ENGINE_FUZZY_CHEWING
+} ConversionEngine;
+
 // XXX not defined by ibus
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(IBusEngine, g_object_unref)
 
@@ -57,11 +122,12 @@ void ibus_chewing_engine_focus_out(IBusEngine *self);
 gboolean ibus_chewing_engine_process_key_event(IBusEngine *self, guint key_sym, guint keycode,
                                                guint modifiers);
 
-char ibus_chewing_engine_get_default_english_case(IBusChewingEngine *self);
-char ibus_chewing_engine_get_chinese_english_toggle_key(IBusChewingEngine *self);
+EnglishCase ibus_chewing_engine_get_default_english_case(IBusChewingEngine *self);
+ChiEngToggle ibus_chewing_engine_get_chinese_english_toggle_key(IBusChewingEngine *self);
 gboolean ibus_chewing_engine_use_vertical_lookup_table(IBusChewingEngine *self);
 gboolean ibus_chewing_engine_use_system_layout(IBusChewingEngine *self);
 void ibus_chewing_engine_notify_chinese_english_mode_change(IBusChewingEngine *self);
 void ibus_chewing_engine_notify_fullwidth_mode_change(IBusChewingEngine *self);
+void ibus_chewing_engine_apply_settings(IBusChewingEngine *self);
 
 G_END_DECLS
\ No newline at end of file
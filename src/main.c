@@ -25,7 +25,6 @@
 #include "MakerDialogUtil.h"
 #include "ibus-chewing-engine.h"
 #include <glib/gi18n.h>
-#include <gtk/gtk.h>
 #include <ibus.h>
 #include <locale.h>
 
@@ -36,6 +35,7 @@ static IBusFactory *factory = NULL;
 static gboolean showFlags = FALSE;
 static gboolean ibus = FALSE;
 static gboolean xml = FALSE;
+static gchar *startupTrace = NULL;
 gint ibus_chewing_verbose = VERBOSE_LEVEL;
 
 static const GOptionEntry entries[] = {
@@ -44,6 +44,8 @@ static const GOptionEntry entries[] = {
     {"verbose", 'v', 0, G_OPTION_ARG_INT, &ibus_chewing_verbose,
      "Verbose level. The higher the level, the more the debug messages.", "[integer]"},
     {"xml", 'x', 0, G_OPTION_ARG_NONE, &xml, "read chewing engine desc from xml file", NULL},
+    {"startup-trace", 0, 0, G_OPTION_ARG_FILENAME, &startupTrace,
+     "Write the time of each startup phase to FILE as JSON", "FILE"},
     {}, // null entry
 };
 
@@ -55,14 +57,18 @@ static void ibus_disconnected_cb([[maybe_unused]] IBusBus *bus,
 
 static void start_component(void) {
     IBUS_CHEWING_LOG(INFO, "start_component");
+    /* Load the dictionary while connecting, before IBus asks for an engine */
+    ibus_chewing_pre_edit_warm_up();
     ibus_init();
     bus = ibus_bus_new();
     g_signal_connect(bus, "disconnected", G_CALLBACK(ibus_disconnected_cb), NULL);
 
     if (!ibus_bus_is_connected(bus)) {
         IBUS_CHEWING_LOG(ERROR, _("Cannot connect to IBus!"));
+        ibus_chewing_startup_finish();
         exit(2);
     }
+    ibus_chewing_startup_mark("ibus_connect");
 
     IBusComponent *component = NULL;
 
@@ -102,6 +108,7 @@ static void start_component(void) {
     // clang-format on
 
     ibus_component_add_engine(component, engineDesc);
+    ibus_chewing_startup_mark("component");
 
     factory = ibus_factory_new(ibus_bus_get_connection(bus));
     ibus_factory_add_engine(factory, "chewing", IBUS_TYPE_CHEWING_ENGINE);
@@ -114,6 +121,7 @@ static void start_component(void) {
     }
 
     g_object_unref(component);
+    ibus_chewing_startup_mark("factory");
     ibus_main();
 }
 
@@ -153,13 +161,14 @@ int main(gint argc, gchar *argv[]) {
     GError *error = NULL;
     GOptionContext *context;
 
-    gtk_init();
+    ibus_chewing_startup_begin();
 
     /* Init i18n messages */
     setlocale(LC_ALL, "");
     bindtextdomain(QUOTE_ME(PROJECT_NAME), QUOTE_ME(DATA_DIR) "/locale");
     textdomain(QUOTE_ME(PROJECT_NAME));
     determine_locale();
+    ibus_chewing_startup_mark("locale");
 
     context = g_option_context_new("- ibus chewing engine component");
 
@@ -172,6 +181,8 @@ int main(gint argc, gchar *argv[]) {
 
     g_option_context_free(context);
     mkdg_log_set_level(ibus_chewing_verbose);
+    ibus_chewing_startup_set_report(startupTrace);
+    ibus_chewing_startup_mark("options");
 
     g_autoptr(GSettings) settings = g_settings_new(QUOTE_ME(PROJECT_SCHEMA_ID));
     g_autoptr(GVariant) plain_zhuyin = g_settings_get_user_value(settings, "plain-zhuyin");
@@ -185,11 +196,13 @@ int main(gint argc, gchar *argv[]) {
         }
         g_settings_reset(settings, "plain-zhuyin");
     }
+    ibus_chewing_startup_mark("settings_migration");
 
     if (showFlags) {
         printf("PROJECT_NAME=" QUOTE_ME(PROJECT_NAME) "\n");
         printf("DATA_DIR=" QUOTE_ME(DATA_DIR) "\n");
         printf("CHEWING_DATADIR_REAL=" QUOTE_ME(CHEWING_DATADIR_REAL) "\n");
+        ibus_chewing_startup_finish();
     } else {
         start_component();
     }
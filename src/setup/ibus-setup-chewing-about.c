@@ -83,6 +83,16 @@ static char *generate_debug_info(void) {
                                g_settings_get_boolean(settings, "vertical-lookup-table"));
         g_string_append_printf(string, "- notify-mode-change: %d\n",
                                g_settings_get_boolean(settings, "notify-mode-change"));
+        g_string_append_printf(string, "- coalesce-ui-updates: %d\n",
+                               g_settings_get_boolean(settings, "coalesce-ui-updates"));
+        g_string_append_printf(string, "- worker-thread: %d\n",
+                               g_settings_get_boolean(settings, "worker-thread"));
+        g_string_append_printf(string, "- worker-key-timeout: %d\n",
+                               g_settings_get_int(settings, "worker-key-timeout"));
+        g_string_append_printf(string, "- deferred-learning: %d\n",
+                               g_settings_get_boolean(settings, "deferred-learning"));
+        g_string_append_printf(string, "- learning-interval: %d\n",
+                               g_settings_get_int(settings, "learning-interval"));
 
         g_free(kb_type);
         g_free(sel_keys);
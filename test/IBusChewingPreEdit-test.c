@@ -36,6 +36,8 @@ void assert_substring(const gchar *haystack, const gchar *needle, gint begin, gi
 }
 
 void key_press_from_key_sym(KSym keySym, KeyModifiers modifiers) {
+    /* As ibus_chewing_engine_process_key_event() does before every key */
+    ibus_chewing_engine_apply_settings(IBUS_CHEWING_ENGINE(self->engine));
     switch (keySym) {
     case IBUS_KEY_Shift_L:
     case IBUS_KEY_Shift_R:
@@ -136,6 +138,59 @@ void filter_modifiers_test() {
     g_assert(filter_modifiers_test_shift_shift_control() == EVENT_RESPONSE_IGNORE);
 }
 
+void key_handling_rule_dispatch_test() {
+    KSym kSym;
+
+    /* Dispatch tables should agree with the linear scan of keyHandlingRules */
+    for (kSym = 0; kSym < 0x20000; kSym++) {
+        g_assert(self_key_sym_find_key_handling_rule(kSym) ==
+                 self_key_sym_find_key_handling_rule_linear(kSym));
+    }
+    g_assert(self_key_sym_find_key_handling_rule(G_MAXUINT) ==
+             self_key_sym_find_key_handling_rule_linear(G_MAXUINT));
+    g_assert(self_key_sym_find_key_handling_rule(IBUS_KEY_KP_Multiply)->keyFunc ==
+             self_key_sym_find_key_handling_rule(IBUS_KEY_KP_0)->keyFunc);
+}
+
+void key_code_to_key_sym_test() {
+    TEST_CASE_INIT();
+    IBusKeymap *keymap = ibus_keymap_get("us");
+    const KeyModifiers mods[] = {0,
+                                 IBUS_SHIFT_MASK,
+                                 IBUS_LOCK_MASK,
+                                 IBUS_SHIFT_MASK | IBUS_LOCK_MASK,
+                                 IBUS_MOD2_MASK,
+                                 IBUS_MOD5_MASK | IBUS_SHIFT_MASK,
+                                 IBUS_CONTROL_MASK,
+                                 IBUS_SHIFT_MASK | IBUS_RELEASE_MASK,
+                                 IBUS_MOD1_MASK | IBUS_MOD2_MASK | IBUS_LOCK_MASK};
+
+    g_object_set(G_OBJECT(self->engine), "use-system-keyboard-layout", FALSE, NULL);
+
+    /* The key sym table should agree with looking up the keymap */
+    for (guint i = 0; i < G_N_ELEMENTS(mods); i++) {
+        for (guint keyCode = 0; keyCode < 300; keyCode++) {
+            KSym expected = ibus_keymap_lookup_keysym(keymap, keyCode, mods[i]);
+
+            if (expected == IBUS_VoidSymbol) {
+                expected = IBUS_KEY_F35;
+            }
+            g_assert_cmpuint(ibus_chewing_pre_edit_key_code_to_key_sym(self, IBUS_KEY_F35, keyCode,
+                                                                       mods[i]),
+                             ==, expected);
+        }
+    }
+
+    /* System layout keeps the key sym */
+    g_object_set(G_OBJECT(self->engine), "use-system-keyboard-layout", TRUE, NULL);
+    g_assert_cmpuint(ibus_chewing_pre_edit_key_code_to_key_sym(self, IBUS_KEY_F35, 0x1e, 0), ==,
+                     IBUS_KEY_F35);
+    g_object_set(G_OBJECT(self->engine), "use-system-keyboard-layout", FALSE, NULL);
+    g_assert_cmpuint(ibus_chewing_pre_edit_key_code_to_key_sym(self, IBUS_KEY_F35, 0x1e, 0), ==,
+                     IBUS_KEY_a);
+    g_object_unref(keymap);
+}
+
 void self_key_sym_fix_test() {
     TEST_CASE_INIT();
     ibus_chewing_pre_edit_set_chi_eng_mode(self, FALSE);
@@ -443,6 +498,133 @@ void process_key_down_arrow_test() {
     assert_outgoing_pre_edit("", "");
 }
 
+void lookup_table_update_unchanged_test() {
+    TEST_CASE_INIT();
+
+    key_press_from_string("t/6g4");
+    key_press_from_key_sym(IBUS_KEY_Down, 0);
+    g_assert(table_is_showing);
+
+    /* Same page again: the table is neither rebuilt nor counted as changed */
+    guint generation = self->tableGeneration;
+    guint count = ibus_lookup_table_get_number_of_candidates(self->iTable);
+    gboolean changed = TRUE;
+
+    g_assert_cmpuint(count, ==,
+                     ibus_chewing_lookup_table_update(self->iTable, self->context, &changed));
+    g_assert_false(changed);
+    g_assert_cmpuint(generation, ==, self->tableGeneration);
+
+    /* Another list */
+    key_press_from_key_sym(IBUS_KEY_Down, 0);
+    g_assert_cmpuint(generation, <, self->tableGeneration);
+
+    ibus_chewing_pre_edit_clear(self);
+    assert_outgoing_pre_edit("", "");
+}
+
+/* 市: the page shown is paged locally, libchewing follows on selection */
+void lookup_table_local_paging_test() {
+    TEST_CASE_INIT();
+
+    key_press_from_string("g4");
+    key_press_from_key_sym(IBUS_KEY_Down, 0);
+    g_assert(table_is_showing);
+    g_assert_cmpuint(ibus_lookup_table_get_number_of_candidates(self->iTable), ==,
+                     chewing_cand_TotalChoice(self->context));
+    g_assert_cmpuint(ibus_chewing_lookup_table_get_total_pages(self->iTable), ==,
+                     chewing_cand_TotalPage(self->context));
+    g_assert_cmpuint(ibus_chewing_lookup_table_get_total_pages(self->iTable), >, 2);
+
+    guint generation = self->tableGeneration;
+
+    key_press_from_key_sym(IBUS_KEY_Page_Down, 0);
+    key_press_from_key_sym(IBUS_KEY_Page_Down, 0);
+    key_press_from_key_sym(IBUS_KEY_Page_Up, 0);
+    g_assert_cmpuint(ibus_chewing_lookup_table_get_page(self->iTable), ==, 1);
+    g_assert_cmpint(chewing_cand_CurrentPage(self->context), ==, 0);
+    g_assert_cmpuint(generation, ==, self->tableGeneration);
+
+    /* Page Up on the first page wraps around without libchewing */
+    key_press_from_key_sym(IBUS_KEY_Page_Up, 0);
+    key_press_from_key_sym(IBUS_KEY_Page_Up, 0);
+    g_assert_cmpuint(ibus_chewing_lookup_table_get_page(self->iTable), ==,
+                     ibus_chewing_lookup_table_get_total_pages(self->iTable) - 1);
+    g_assert_cmpint(chewing_cand_CurrentPage(self->context), ==, 0);
+    key_press_from_key_sym(IBUS_KEY_Page_Down, 0);
+    key_press_from_key_sym(IBUS_KEY_Page_Down, 0);
+    g_assert_cmpuint(ibus_chewing_lookup_table_get_page(self->iTable), ==, 1);
+
+    /* Selection picks from the page shown */
+    guint pageSize = ibus_lookup_table_get_page_size(self->iTable);
+    g_autofree gchar *expected =
+        g_strdup(ibus_lookup_table_get_candidate(self->iTable, pageSize + 1)->text);
+
+    key_press_from_string("2");
+    g_assert(!table_is_showing);
+    assert_outgoing_pre_edit("", expected);
+
+    ibus_chewing_pre_edit_clear(self);
+    assert_outgoing_pre_edit("", "");
+}
+
+/* 市: opening the same list again takes its texts from the intern table */
+void lookup_table_text_intern_test() {
+    TEST_CASE_INIT();
+    IBusChewingCandidateTextStats before, after;
+
+    key_press_from_string("g4");
+    key_press_from_key_sym(IBUS_KEY_Down, 0);
+    g_assert(table_is_showing);
+    IBusText *iText = ibus_lookup_table_get_candidate(self->iTable, 0);
+    guint count = ibus_lookup_table_get_number_of_candidates(self->iTable);
+
+    key_press_from_key_sym(IBUS_KEY_Escape, 0);
+    g_assert(!table_is_showing);
+
+    ibus_chewing_lookup_table_get_text_stats(&before);
+    key_press_from_key_sym(IBUS_KEY_Down, 0);
+    g_assert(table_is_showing);
+    ibus_chewing_lookup_table_get_text_stats(&after);
+    g_assert_cmpuint(after.hits, ==, before.hits + count);
+    g_assert_cmpuint(after.misses, ==, before.misses);
+    g_assert(ibus_lookup_table_get_candidate(self->iTable, 0) == iText);
+
+    ibus_chewing_pre_edit_clear(self);
+    assert_outgoing_pre_edit("", "");
+}
+
+/* libchewing options are changed only when a key needs another value */
+void config_mirror_test() {
+    TEST_CASE_INIT();
+    IBusChewingPreEditConfig config = self->config;
+
+    ibus_chewing_pre_edit_set_easy_symbol_input(self, TRUE);
+    ibus_chewing_pre_edit_set_esc_clean_all_buf(self, FALSE);
+
+    key_press_from_string("g4");
+    g_assert_cmpint(self->applied.easySymbolInput, ==, 0);
+    g_assert_cmpint(chewing_get_easySymbolInput(self->context), ==, 0);
+
+    /* Forced on for the clear only */
+    ibus_chewing_pre_edit_clear_pre_edit(self);
+    assert_outgoing_pre_edit("", "");
+    g_assert_cmpint(self->applied.escCleanAllBuf, ==, 0);
+    g_assert_cmpint(chewing_get_escCleanAllBuf(self->context), ==, 0);
+    key_press_from_string("g4");
+    key_press_from_key_sym(IBUS_KEY_Escape, 0);
+    g_assert_cmpint(chewing_get_escCleanAllBuf(self->context), ==, 0);
+
+    gint *selKeys = chewing_get_selKey(self->context);
+
+    g_assert(memcmp(self->selKeys, selKeys, sizeof(self->selKeys)) == 0);
+    chewing_free(selKeys);
+
+    self->config = config;
+    ibus_chewing_pre_edit_clear(self);
+    assert_outgoing_pre_edit("", "");
+}
+
 /* Test shift then caps then caps then shift */
 /* String: 我要去 Brisbane 了。Daddy 好嗎 */
 /* Bug before 1.5.0 */
@@ -615,6 +797,57 @@ void test_ibus_chewing_pre_edit_clear_pre_edit() {
     assert_outgoing_pre_edit("", "");
 }
 
+/* preEdit rebuilt from scratch should equal the incrementally updated one */
+void assert_pre_edit_consistent() {
+    gchar *bufferStr = chewing_buffer_String(self->context);
+    const gchar *bpmfStr = chewing_bopomofo_String_static(self->context);
+    gint cursor = chewing_cursor_Current(self->context);
+    gchar *before = g_utf8_substring(bufferStr, 0, cursor);
+    gchar *expected = g_strconcat(before, bpmfStr, bufferStr + strlen(before), NULL);
+
+    g_assert_cmpstr(expected, ==, ibus_chewing_pre_edit_get_pre_edit(self));
+    g_assert_cmpint(g_utf8_strlen(expected, -1), ==, self->wordLen);
+    g_assert_cmpuint(self->charOffsets->len, ==, g_utf8_strlen(bufferStr, -1) + 1);
+    for (guint i = 0; i < self->charOffsets->len; i++) {
+        gsize offset = g_array_index(self->charOffsets, gsize, i);
+
+        g_assert_cmpuint(offset, ==, g_utf8_offset_to_pointer(bufferStr, i) - bufferStr);
+    }
+    chewing_free(bufferStr);
+    g_free(before);
+    g_free(expected);
+}
+
+void test_ibus_chewing_pre_edit_incremental_update() {
+    TEST_CASE_INIT();
+
+    key_press_from_string("su3cl3");
+    assert_outgoing_pre_edit("", "你好");
+    assert_pre_edit_consistent();
+
+    key_press_from_key_sym(IBUS_KEY_Left, 0);
+    key_press_from_string("u"); /* ㄧ inserted before 好 */
+    assert_outgoing_pre_edit("", "你ㄧ好");
+    assert_pre_edit_consistent();
+
+    key_press_from_key_sym(IBUS_KEY_BackSpace, 0);
+    assert_outgoing_pre_edit("", "你好");
+    assert_pre_edit_consistent();
+
+    key_press_from_string("5j/ ");
+    assert_pre_edit_consistent();
+    key_press_from_key_sym(IBUS_KEY_Home, 0);
+    key_press_from_key_sym(IBUS_KEY_Delete, 0);
+    assert_pre_edit_consistent();
+    key_press_from_key_sym(IBUS_KEY_End, 0);
+    key_press_from_key_sym(IBUS_KEY_BackSpace, 0);
+    assert_pre_edit_consistent();
+
+    ibus_chewing_pre_edit_clear(self);
+    assert_outgoing_pre_edit("", "");
+    assert_pre_edit_consistent();
+}
+
 void test_ibus_chewing_pre_edit_set_chi_eng_mode() {
     TEST_CASE_INIT();
 
@@ -641,15 +874,15 @@ void test_arrow_keys_buffer_empty() {
 
     key_press_from_string("`");
     g_assert(ibus_chewing_pre_edit_has_flag(self, FLAG_TABLE_SHOW));
-    g_assert(chewing_cand_CurrentPage(self->context) == 0);
+    g_assert(ibus_chewing_lookup_table_get_page(self->iTable) == 0);
     key_press_from_key_sym(IBUS_KEY_Right, 0);
-    g_assert(chewing_cand_CurrentPage(self->context) == 1);
+    g_assert(ibus_chewing_lookup_table_get_page(self->iTable) == 1);
     key_press_from_key_sym(IBUS_KEY_Left, 0);
-    g_assert(chewing_cand_CurrentPage(self->context) == 0);
+    g_assert(ibus_chewing_lookup_table_get_page(self->iTable) == 0);
     key_press_from_key_sym(IBUS_KEY_Page_Down, 0);
-    g_assert(chewing_cand_CurrentPage(self->context) == 1);
+    g_assert(ibus_chewing_lookup_table_get_page(self->iTable) == 1);
     key_press_from_key_sym(IBUS_KEY_Page_Up, 0);
-    g_assert(chewing_cand_CurrentPage(self->context) == 0);
+    g_assert(ibus_chewing_lookup_table_get_page(self->iTable) == 0);
     key_press_from_key_sym(IBUS_KEY_Escape, 0);
     g_assert(!ibus_chewing_pre_edit_has_flag(self, FLAG_TABLE_SHOW));
 
@@ -790,6 +1023,20 @@ void test_keypad() {
     test_kp_other_keys();
 }
 
+void warm_up_test() {
+    ibus_chewing_pre_edit_warm_up();
+    IBusChewingPreEdit *preEdit = ibus_chewing_pre_edit_new();
+
+    g_assert(preEdit->context != NULL);
+    g_assert(ibus_chewing_pre_edit_get_chi_eng_mode(preEdit));
+    ibus_chewing_pre_edit_free(preEdit);
+
+    /* Without a warm-up the context is built on the spot */
+    preEdit = ibus_chewing_pre_edit_new();
+    g_assert(preEdit->context != NULL);
+    ibus_chewing_pre_edit_free(preEdit);
+}
+
 gint main(gint argc, gchar **argv) {
     g_test_init(&argc, &argv, NULL);
     mkdg_log_set_level(DEBUG);
@@ -800,7 +1047,10 @@ gint main(gint argc, gchar **argv) {
     g_object_set(G_OBJECT(self->engine), "auto-shift-cur", TRUE, NULL);
     g_object_set(G_OBJECT(self->engine), "enable-fullwidth-toggle-key", TRUE, NULL);
 
+    TEST_RUN_THIS(warm_up_test);
     TEST_RUN_THIS(filter_modifiers_test);
+    TEST_RUN_THIS(key_handling_rule_dispatch_test);
+    TEST_RUN_THIS(key_code_to_key_sym_test);
     TEST_RUN_THIS(self_key_sym_fix_test);
     TEST_RUN_THIS(self_handle_key_sym_default_test);
     TEST_RUN_THIS(process_key_default_english_test);
@@ -810,6 +1060,10 @@ gint main(gint argc, gchar **argv) {
     TEST_RUN_THIS(process_key_incomplete_char_test);
     TEST_RUN_THIS(process_key_buffer_full_handling_test);
     TEST_RUN_THIS(process_key_down_arrow_test);
+    TEST_RUN_THIS(lookup_table_update_unchanged_test);
+    TEST_RUN_THIS(lookup_table_local_paging_test);
+    TEST_RUN_THIS(lookup_table_text_intern_test);
+    TEST_RUN_THIS(config_mirror_test);
     TEST_RUN_THIS(process_key_shift_and_caps_test);
     TEST_RUN_THIS(full_half_shape_test);
     TEST_RUN_THIS(plain_zhuyin_test);
@@ -817,6 +1071,7 @@ gint main(gint argc, gchar **argv) {
     TEST_RUN_THIS(plain_zhuyin_full_half_shape_test);
     TEST_RUN_THIS(test_ibus_chewing_pre_edit_clear_bopomofo);
     TEST_RUN_THIS(test_ibus_chewing_pre_edit_clear_pre_edit);
+    TEST_RUN_THIS(test_ibus_chewing_pre_edit_incremental_update);
     TEST_RUN_THIS(test_ibus_chewing_pre_edit_set_chi_eng_mode);
     TEST_RUN_THIS(test_space_as_selection);
     TEST_RUN_THIS(test_arrow_keys_buffer_empty);
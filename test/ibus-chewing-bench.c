@@ -0,0 +1,738 @@
+/*
+ * Benchmarks for the ibus-chewing engine.
+ *
+ * replay:     Replays key sequences through ibus_chewing_engine_process_key_event()
+ *             and reports per-keystroke latency percentiles and throughput.
+ * dispatch:   Cost of finding the key handling rule of a key.
+ * engine-new: Time to create an engine and apply the settings to it.
+ * keysym:     Key code to key sym translation, keymap lookup vs. the key sym table.
+ * startup:    Time to start the engine binary (--show_flags, so no IBus is needed)
+ *             and its peak RSS. Pass --engine to compare with another build.
+ * first-key:  Creating the first engine and typing the first key in a fresh process,
+ *             with (warm) and without (cold) warming up the chewing context first.
+ *
+ * Input format (one sequence per line, '#' starts a comment line):
+ *   Printable ASCII characters are typed on an US keyboard;
+ *   upper case letters and shifted symbols are typed with Shift.
+ *   <Name> types the key named Name (e.g. <Return>, <Down>, <Shift_L>).
+ *   <S-Name> and <C-Name> add Shift and Control respectively.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "IBusChewingPreEdit.h"
+#include "IBusChewingPreEdit-private.h"
+#include "MakerDialogUtil.h"
+#include "ibus-chewing-engine-private.h"
+#include "ibus-chewing-engine.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* evdev key codes of the keys that are not printable */
+#define EVDEV_ESC 1
+#define EVDEV_BACKSPACE 14
+#define EVDEV_TAB 15
+#define EVDEV_ENTER 28
+#define EVDEV_LEFTCTRL 29
+#define EVDEV_LEFTSHIFT 42
+#define EVDEV_RIGHTSHIFT 54
+#define EVDEV_SPACE 57
+#define EVDEV_CAPSLOCK 58
+#define EVDEV_HOME 102
+#define EVDEV_UP 103
+#define EVDEV_PAGEUP 104
+#define EVDEV_LEFT 105
+#define EVDEV_RIGHT 106
+#define EVDEV_END 107
+#define EVDEV_DOWN 108
+#define EVDEV_PAGEDOWN 109
+#define EVDEV_DELETE 111
+
+/**
+ * BenchKey:
+ * @keySym:  Key symbol sent to the engine.
+ * @keyCode: evdev key code of @keySym on an US keyboard.
+ * @mods:    Modifiers held while the key is pressed.
+ *
+ * One keystroke (press and release) of a replayed sequence.
+ */
+typedef struct {
+    KSym keySym;
+    guint keyCode;
+    KeyModifiers mods;
+} BenchKey;
+
+/* Rows of an US keyboard, with the evdev key code of the first key of each row */
+static const struct {
+    const gchar *plain;
+    const gchar *shifted;
+    guint firstCode;
+} usRows[] = {
+    {"1234567890-=", "!@#$%^&*()_+", 2},
+    {"qwertyuiop[]", "QWERTYUIOP{}", 16},
+    {"asdfghjkl;'`", "ASDFGHJKL:\"~", 30},
+    {"\\zxcvbnm,./", "|ZXCVBNM<>?", 43},
+};
+
+// clang-format off
+static const struct {
+    KSym keySym;
+    guint keyCode;
+} specialKeys[] = {
+    {IBUS_KEY_Escape, EVDEV_ESC},
+    {IBUS_KEY_BackSpace, EVDEV_BACKSPACE},
+    {IBUS_KEY_Tab, EVDEV_TAB},
+    {IBUS_KEY_Return, EVDEV_ENTER},
+    {IBUS_KEY_Control_L, EVDEV_LEFTCTRL},
+    {IBUS_KEY_Shift_L, EVDEV_LEFTSHIFT},
+    {IBUS_KEY_Shift_R, EVDEV_RIGHTSHIFT},
+    {IBUS_KEY_space, EVDEV_SPACE},
+    {IBUS_KEY_Caps_Lock, EVDEV_CAPSLOCK},
+    {IBUS_KEY_Home, EVDEV_HOME},
+    {IBUS_KEY_Up, EVDEV_UP},
+    {IBUS_KEY_Page_Up, EVDEV_PAGEUP},
+    {IBUS_KEY_Left, EVDEV_LEFT},
+    {IBUS_KEY_Right, EVDEV_RIGHT},
+    {IBUS_KEY_End, EVDEV_END},
+    {IBUS_KEY_Down, EVDEV_DOWN},
+    {IBUS_KEY_Page_Down, EVDEV_PAGEDOWN},
+    {IBUS_KEY_Delete, EVDEV_DELETE},
+};
+
+/* Same order as the kb-type choices in the GSettings schema */
+static const gchar *kbTypes[] = {
+    "default",
+    "hsu",
+    "ibm",
+    "gin_yieh",
+    "eten",
+    "eten26",
+    "dvorak",
+    "dvorak_hsu",
+    "dachen_26",
+    "hanyu",
+    "thl_pinying",
+    "mps2_pinyin",
+    "carpalx",
+    "colemak",
+    "colemak_dh_ansi",
+    "colemak_dh_orth",
+    "workman",
+    NULL
+};
+// clang-format on
+
+/* Sequences taken from the unit tests, typed with the default layout */
+static const gchar *builtinCorpus[] = {
+    "su3cl3<Return>",
+    "5j/ jp6<Return>",
+    "w8 <Down>2<Return>",
+    "1j65j/4<Down>3<Return>",
+    "w8 g4ji3vm/ 2u4<Return>",
+    "5k4g4<Shift_L>ibus-chewing <Shift_L>gj bj4z83<Return>",
+    "ji3ru8 ap6fu06u.3vul3ck6<S-less>c.4au04u.3g0 qi <Return>",
+    "t/6g4<Down>1<Down>2<Return>",
+    "ji3ul4fm4 <Shift_L>Brisbane <Shift_L>cl3a87<Return>",
+    "su3cl3<BackSpace><BackSpace>cl3<Left><Left><Delete><Return>",
+    "<C-2>j3j3<C-2><Escape>",
+    NULL,
+};
+
+static gint optIterations = 20;
+static gchar *optKbType = NULL;
+static gchar *optMode = NULL;
+static gchar *optInput = NULL;
+static gchar *optSuite = NULL;
+static gchar *optEngine = NULL;
+static gint optStartupGap = 50;
+
+static GOptionEntry entries[] = {
+    {"iterations", 'n', 0, G_OPTION_ARG_INT, &optIterations,
+     "Number of timed passes over the corpus (default: 20)", "N"},
+    {"kb-type", 'k', 0, G_OPTION_ARG_STRING, &optKbType,
+     "Keyboard layout to benchmark, or \"all\" (default: default)", "TYPE"},
+    {"mode", 'm', 0, G_OPTION_ARG_STRING, &optMode,
+     "warm: reuse one engine; cold: new engine per pass; both (default: both)", "MODE"},
+    {"input", 'i', 0, G_OPTION_ARG_FILENAME, &optInput,
+     "File with recorded key sequences (default: built-in corpus)", "FILE"},
+    {"suite", 's', 0, G_OPTION_ARG_STRING, &optSuite,
+     "Benchmark to run: replay, dispatch, engine-new, keysym, startup, first-key or all "
+     "(default: all)",
+     "SUITE"},
+    {"engine", 'e', 0, G_OPTION_ARG_FILENAME, &optEngine,
+     "Engine binary for the startup suite (default: the one in the build tree)", "FILE"},
+    {"startup-gap", 0, 0, G_OPTION_ARG_INT, &optStartupGap,
+     "Milliseconds between component start and IBus asking for an engine (default: 50)", "MS"},
+    G_OPTION_ENTRY_NULL,
+};
+
+/*== Corpus ==*/
+static guint key_code_from_key_sym(KSym keySym, gboolean *shifted) {
+    *shifted = FALSE;
+    for (guint i = 0; i < G_N_ELEMENTS(specialKeys); i++) {
+        if (specialKeys[i].keySym == keySym) {
+            return specialKeys[i].keyCode;
+        }
+    }
+    if (keySym > 0x7f) {
+        return 0;
+    }
+    for (guint i = 0; i < G_N_ELEMENTS(usRows); i++) {
+        const gchar *p = strchr(usRows[i].plain, (gchar)keySym);
+
+        if (p != NULL && keySym != 0) {
+            return usRows[i].firstCode + (guint)(p - usRows[i].plain);
+        }
+        p = strchr(usRows[i].shifted, (gchar)keySym);
+        if (p != NULL && keySym != 0) {
+            *shifted = TRUE;
+            return usRows[i].firstCode + (guint)(p - usRows[i].shifted);
+        }
+    }
+    return 0;
+}
+
+static void corpus_append_key(GArray *keys, KSym keySym, KeyModifiers mods) {
+    gboolean shifted;
+    BenchKey key = {keySym, key_code_from_key_sym(keySym, &shifted), mods};
+
+    if (shifted) {
+        key.mods |= IBUS_SHIFT_MASK;
+    }
+    g_array_append_val(keys, key);
+}
+
+/* Return FALSE if the line contains a key name that IBus does not know */
+static gboolean corpus_parse_line(GArray *keys, const gchar *line) {
+    const gchar *p = line;
+
+    while (*p != '\0' && *p != '\n' && *p != '\r') {
+        if (*p != '<' || p[1] == '\0' || p[1] == '>') {
+            corpus_append_key(keys, (guchar)*p, 0);
+            p++;
+            continue;
+        }
+        const gchar *end = strchr(p, '>');
+
+        if (end == NULL) {
+            g_printerr("Unterminated key name: %s\n", p);
+            return FALSE;
+        }
+        g_autofree gchar *name = g_strndup(p + 1, end - p - 1);
+        const gchar *keyName = name;
+        KeyModifiers mods = 0;
+
+        while (strlen(keyName) > 2 && keyName[1] == '-') {
+            if (keyName[0] == 'S') {
+                mods |= IBUS_SHIFT_MASK;
+            } else if (keyName[0] == 'C') {
+                mods |= IBUS_CONTROL_MASK;
+            } else {
+                break;
+            }
+            keyName += 2;
+        }
+        KSym keySym = ibus_keyval_from_name(keyName);
+
+        if (keySym == IBUS_KEY_VoidSymbol) {
+            g_printerr("Unknown key name: %s\n", keyName);
+            return FALSE;
+        }
+        corpus_append_key(keys, keySym, mods);
+        p = end + 1;
+    }
+    return TRUE;
+}
+
+static GArray *corpus_load(const gchar *filename) {
+    GArray *keys = g_array_new(FALSE, FALSE, sizeof(BenchKey));
+
+    if (filename == NULL) {
+        for (gint i = 0; builtinCorpus[i] != NULL; i++) {
+            corpus_parse_line(keys, builtinCorpus[i]);
+        }
+        return keys;
+    }
+
+    g_autofree gchar *contents = NULL;
+    g_autoptr(GError) error = NULL;
+
+    if (!g_file_get_contents(filename, &contents, NULL, &error)) {
+        g_printerr("Cannot read %s: %s\n", filename, error->message);
+        g_array_free(keys, TRUE);
+        return NULL;
+    }
+    gchar **lines = g_strsplit(contents, "\n", -1);
+
+    for (gint i = 0; lines[i] != NULL; i++) {
+        if (lines[i][0] == '#' || lines[i][0] == '\0') {
+            continue;
+        }
+        if (!corpus_parse_line(keys, lines[i])) {
+            g_strfreev(lines);
+            g_array_free(keys, TRUE);
+            return NULL;
+        }
+    }
+    g_strfreev(lines);
+    return keys;
+}
+
+/*== Measurement ==*/
+static gint64 now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static gint compare_gint64(gconstpointer a, gconstpointer b) {
+    gint64 x = *(const gint64 *)a;
+    gint64 y = *(const gint64 *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted samples */
+static gint64 percentile(GArray *samples, gdouble p) {
+    guint rank = (guint)(p / 100.0 * samples->len + 0.999999);
+
+    rank = CLAMP(rank, 1, samples->len);
+    return g_array_index(samples, gint64, rank - 1);
+}
+
+static void report(const gchar *suite, const gchar *kbType, const gchar *mode, const gchar *unit,
+                   GArray *samples) {
+    gint64 total = 0;
+
+    if (samples->len == 0) {
+        return;
+    }
+    for (guint i = 0; i < samples->len; i++) {
+        total += g_array_index(samples, gint64, i);
+    }
+    g_array_sort(samples, compare_gint64);
+    printf("%-10s kb=%-16s mode=%-4s %s=%-7u p50=%8.2fus p95=%8.2fus p99=%8.2fus "
+           "max=%9.2fus %s/s=%.0f\n",
+           suite, kbType, mode, unit, samples->len, percentile(samples, 50) / 1000.0,
+           percentile(samples, 95) / 1000.0, percentile(samples, 99) / 1000.0,
+           g_array_index(samples, gint64, samples->len - 1) / 1000.0, unit,
+           samples->len * 1e9 / (gdouble)total);
+}
+
+/* The UNIT_TEST stubs of parent_* print every emission, keep them off the report */
+static gint stdout_silence() {
+    gint saved = dup(STDOUT_FILENO);
+    gint devNull = open("/dev/null", O_WRONLY);
+
+    fflush(stdout);
+    dup2(devNull, STDOUT_FILENO);
+    close(devNull);
+    return saved;
+}
+
+static void stdout_restore(gint saved) {
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+/*== Replay ==*/
+static IBusChewingEngine *bench_engine_new(const gchar *kbType) {
+    IBusChewingEngine *engine = g_object_new(IBUS_TYPE_CHEWING_ENGINE, NULL);
+
+    /* Settings are not bound in UNIT_TEST, so apply the schema defaults */
+    g_object_set(G_OBJECT(engine), "kb-type", kbType, "sel-keys", "1234567890",
+                 "cand-per-page", 5, "max-chi-symbol-len", 20, "default-english-case",
+                 "lowercase", "chi-eng-mode-toggle", "caps_lock", "sync-caps-lock", "keyboard",
+                 "conversion-engine", "chewing", NULL);
+    g_signal_emit_by_name(engine, "set_capabilities", IBUS_CAP_AUXILIARY_TEXT);
+    ibus_chewing_engine_focus_in(IBUS_ENGINE(engine));
+    ibus_chewing_engine_enable(IBUS_ENGINE(engine));
+    return engine;
+}
+
+static void bench_key_event(IBusEngine *engine, KSym keySym, guint keyCode, KeyModifiers mods) {
+    ibus_chewing_engine_process_key_event(engine, keySym, keyCode, mods);
+}
+
+/* Replay the corpus once; record the time of every keystroke if samples is not NULL */
+static void bench_replay(IBusChewingEngine *engine, GArray *keys, GArray *samples) {
+    IBusEngine *e = IBUS_ENGINE(engine);
+
+    for (guint i = 0; i < keys->len; i++) {
+        BenchKey *key = &g_array_index(keys, BenchKey, i);
+        gboolean withShift = (key->mods & IBUS_SHIFT_MASK) && key->keySym != IBUS_KEY_Shift_L &&
+                             key->keySym != IBUS_KEY_Shift_R;
+        gint64 start = now_ns();
+
+        if (withShift) {
+            bench_key_event(e, IBUS_KEY_Shift_L, EVDEV_LEFTSHIFT, 0);
+        }
+        bench_key_event(e, key->keySym, key->keyCode, key->mods);
+        bench_key_event(e, key->keySym, key->keyCode, key->mods | IBUS_RELEASE_MASK);
+        if (withShift) {
+            bench_key_event(e, IBUS_KEY_Shift_L, EVDEV_LEFTSHIFT,
+                            IBUS_SHIFT_MASK | IBUS_RELEASE_MASK);
+        }
+        if (samples != NULL) {
+            gint64 elapsed = now_ns() - start;
+
+            g_array_append_val(samples, elapsed);
+        }
+    }
+    ibus_chewing_pre_edit_clear(engine->icPreEdit);
+}
+
+static void bench_warm(const gchar *kbType, GArray *keys) {
+    g_autoptr(GArray) samples = g_array_new(FALSE, FALSE, sizeof(gint64));
+    gint saved = stdout_silence();
+    IBusChewingEngine *engine = bench_engine_new(kbType);
+
+    /* Untimed pass so that dictionaries and caches are hot */
+    bench_replay(engine, keys, NULL);
+    IBusChewingEngineStats stats = engine->stats;
+    IBusChewingCandidateTextStats textStats, textStatsAfter;
+
+    ibus_chewing_lookup_table_get_text_stats(&textStats);
+    for (gint i = 0; i < optIterations; i++) {
+        bench_replay(engine, keys, samples);
+    }
+    ibus_chewing_lookup_table_get_text_stats(&textStatsAfter);
+    stats.updatesSent = engine->stats.updatesSent - stats.updatesSent;
+    stats.updatesSaved = engine->stats.updatesSaved - stats.updatesSaved;
+    stats.objectsCreated = engine->stats.objectsCreated - stats.objectsCreated;
+    stats.keysPassedThrough = engine->stats.keysPassedThrough - stats.keysPassedThrough;
+    g_object_unref(engine);
+    stdout_restore(saved);
+    report("replay", kbType, "warm", "keys", samples);
+    if (samples->len > 0) {
+        printf("%-10s kb=%-16s mode=%-4s ui-updates sent/key=%.2f saved/key=%.2f "
+               "text-objects/key=%.2f passed-through/key=%.2f\n",
+               "replay", kbType, "warm", stats.updatesSent / (gdouble)samples->len,
+               stats.updatesSaved / (gdouble)samples->len,
+               stats.objectsCreated / (gdouble)samples->len,
+               stats.keysPassedThrough / (gdouble)samples->len);
+        printf("%-10s kb=%-16s mode=%-4s candidate-texts hits=%" G_GUINT64_FORMAT
+               " misses=%" G_GUINT64_FORMAT " size=%u\n",
+               "replay", kbType, "warm", textStatsAfter.hits - textStats.hits,
+               textStatsAfter.misses - textStats.misses, textStatsAfter.size);
+    }
+}
+
+static void bench_cold(const gchar *kbType, GArray *keys) {
+    g_autoptr(GArray) samples = g_array_new(FALSE, FALSE, sizeof(gint64));
+    gint saved = stdout_silence();
+
+    for (gint i = 0; i < optIterations; i++) {
+        IBusChewingEngine *engine = bench_engine_new(kbType);
+
+        bench_replay(engine, keys, samples);
+        g_object_unref(engine);
+    }
+    stdout_restore(saved);
+    report("replay", kbType, "cold", "keys", samples);
+}
+
+/* Lookup cost of keyHandlingRules, for the keys of the corpus */
+#define DISPATCH_ROUNDS 20000
+
+static void bench_dispatch(const gchar *name, KeyHandlingRule *(*find)(KSym), GArray *keys) {
+    volatile KeyHandlingFunc sink = NULL;
+    gint64 start = now_ns();
+
+    for (gint round = 0; round < DISPATCH_ROUNDS; round++) {
+        for (guint i = 0; i < keys->len; i++) {
+            sink = find(g_array_index(keys, BenchKey, i).keySym)->keyFunc;
+        }
+    }
+    gint64 elapsed = now_ns() - start;
+    guint64 lookups = (guint64)DISPATCH_ROUNDS * keys->len;
+
+    (void)sink;
+    printf("%-10s find=%-6s lookups=%-9" G_GUINT64_FORMAT " ns/key=%.2f\n", "dispatch", name,
+           lookups, elapsed / (gdouble)lookups);
+}
+
+static void bench_suite_dispatch(GArray *keys) {
+    if (keys->len == 0) {
+        return;
+    }
+    /* Build the dispatch tables */
+    ibus_chewing_pre_edit_free(ibus_chewing_pre_edit_new());
+    bench_dispatch("linear", self_key_sym_find_key_handling_rule_linear, keys);
+    bench_dispatch("table", self_key_sym_find_key_handling_rule, keys);
+}
+
+/* Key code to key sym translation in Chinese mode, for the keys of the corpus */
+#define KEYSYM_ROUNDS 20000
+
+/* Translation before the key sym table: a keymap lookup per key */
+static KSym key_code_to_key_sym_keymap([[maybe_unused]] IBusChewingPreEdit *self, KSym keySym,
+                                       guint keyCode, KeyModifiers unmaskedMod) {
+    IBusKeymap *keymap = ibus_keymap_get("us");
+    KSym kSym = ibus_keymap_lookup_keysym(keymap, keyCode, unmaskedMod);
+
+    g_object_unref(keymap);
+    return (kSym == IBUS_VoidSymbol) ? keySym : kSym;
+}
+
+static void bench_keysym(const gchar *name,
+                         KSym (*translate)(IBusChewingPreEdit *, KSym, guint, KeyModifiers),
+                         IBusChewingPreEdit *icPreEdit, GArray *keys) {
+    volatile KSym sink = 0;
+    gint64 start = now_ns();
+
+    for (gint round = 0; round < KEYSYM_ROUNDS; round++) {
+        for (guint i = 0; i < keys->len; i++) {
+            BenchKey *key = &g_array_index(keys, BenchKey, i);
+
+            sink = translate(icPreEdit, key->keySym, key->keyCode, key->mods);
+        }
+    }
+    gint64 elapsed = now_ns() - start;
+    guint64 lookups = (guint64)KEYSYM_ROUNDS * keys->len;
+
+    (void)sink;
+    printf("%-10s path=%-6s lookups=%-9" G_GUINT64_FORMAT " ns/key=%.2f\n", "keysym", name,
+           lookups, elapsed / (gdouble)lookups);
+}
+
+static void bench_suite_keysym(GArray *keys) {
+    if (keys->len == 0) {
+        return;
+    }
+    gint saved = stdout_silence();
+    IBusChewingEngine *engine = bench_engine_new("default");
+
+    stdout_restore(saved);
+    ibus_chewing_pre_edit_set_chi_eng_mode(engine->icPreEdit, TRUE);
+    bench_keysym("keymap", key_code_to_key_sym_keymap, engine->icPreEdit, keys);
+    bench_keysym("table", ibus_chewing_pre_edit_key_code_to_key_sym, engine->icPreEdit, keys);
+    g_object_unref(engine);
+}
+
+/* Engine construction and settings application, as done when IBus creates an engine */
+static void bench_suite_engine_new([[maybe_unused]] GArray *keys) {
+    const gchar *kbType = (optKbType != NULL && !STRING_EQUALS(optKbType, "all")) ? optKbType
+                                                                                   : "default";
+    g_autoptr(GArray) samples = g_array_new(FALSE, FALSE, sizeof(gint64));
+    gint saved = stdout_silence();
+
+    for (gint i = 0; i < optIterations; i++) {
+        gint64 start = now_ns();
+        IBusChewingEngine *engine = bench_engine_new(kbType);
+        gint64 elapsed = now_ns() - start;
+
+        g_array_append_val(samples, elapsed);
+        g_object_unref(engine);
+    }
+    stdout_restore(saved);
+    report("engine-new", kbType, "cold", "engines", samples);
+}
+
+/*
+ * Process start to exit of the engine binary: dynamic linking and
+ * everything main() does before connecting to IBus.
+ * ru_maxrss of the children also counts the image they were spawned from,
+ * so the bench's own peak is printed as the floor of the figure.
+ */
+static void bench_suite_startup([[maybe_unused]] GArray *keys) {
+    const gchar *engine = (optEngine != NULL) ? optEngine : ENGINE_PATH;
+    gchar *argv[] = {(gchar *)engine, (gchar *)"--show_flags", NULL};
+    g_autoptr(GArray) samples = g_array_new(FALSE, FALSE, sizeof(gint64));
+    struct rusage selfUsage;
+    struct rusage childUsage;
+
+    for (gint i = 0; i < optIterations; i++) {
+        g_autoptr(GError) error = NULL;
+        gint status;
+        gint64 start = now_ns();
+
+        if (!g_spawn_sync(NULL, argv, NULL, G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
+                          NULL, NULL, NULL, NULL, &status, &error) ||
+            !g_spawn_check_wait_status(status, &error)) {
+            g_printerr("Cannot run %s: %s\n", engine, error->message);
+            return;
+        }
+        gint64 elapsed = now_ns() - start;
+
+        g_array_append_val(samples, elapsed);
+    }
+    report("startup", "-", "cold", "execs", samples);
+    getrusage(RUSAGE_SELF, &selfUsage);
+    getrusage(RUSAGE_CHILDREN, &childUsage);
+    printf("%-10s maxrss=%ldKiB (bench %ldKiB) %s\n", "startup", childUsage.ru_maxrss,
+           selfUsage.ru_maxrss, engine);
+}
+
+/*
+ * Runs in a forked child so libchewing starts cold.
+ * The gap stands for connecting to IBus and registering the component,
+ * which the warm-up overlaps.
+ */
+static gint64 first_key_in_child(const gchar *kbType, gboolean warmUp) {
+    gint fds[2];
+    gint64 elapsed = -1;
+
+    fflush(stdout);
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        close(fds[0]);
+        stdout_silence();
+        if (warmUp) {
+            ibus_chewing_pre_edit_warm_up();
+        }
+        g_usleep(optStartupGap * 1000);
+
+        gint64 start = now_ns();
+        IBusChewingEngine *engine = bench_engine_new(kbType);
+
+        bench_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+        elapsed = now_ns() - start;
+        if (write(fds[1], &elapsed, sizeof(elapsed)) != sizeof(elapsed)) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    if (pid > 0) {
+        if (read(fds[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed)) {
+            elapsed = -1;
+        }
+        waitpid(pid, NULL, 0);
+    }
+    close(fds[0]);
+    return elapsed;
+}
+
+/* From IBus asking for the first engine to the first key being handled */
+static void bench_suite_first_key([[maybe_unused]] GArray *keys) {
+    const gchar *kbType = (optKbType != NULL && !STRING_EQUALS(optKbType, "all")) ? optKbType
+                                                                                   : "default";
+
+    for (gint warmUp = 0; warmUp <= 1; warmUp++) {
+        g_autoptr(GArray) samples = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+        for (gint i = 0; i < optIterations; i++) {
+            gint64 elapsed = first_key_in_child(kbType, warmUp);
+
+            if (elapsed < 0) {
+                g_printerr("first-key: child process failed\n");
+                return;
+            }
+            g_array_append_val(samples, elapsed);
+        }
+        report("first-key", kbType, warmUp ? "warm" : "cold", "procs", samples);
+    }
+}
+
+static void bench_suite_replay(GArray *keys) {
+    const gchar *kbType = (optKbType != NULL) ? optKbType : "default";
+    const gchar *mode = (optMode != NULL) ? optMode : "both";
+
+    for (gint i = 0; kbTypes[i] != NULL; i++) {
+        if (!STRING_EQUALS(kbType, "all") && !STRING_EQUALS(kbType, kbTypes[i])) {
+            continue;
+        }
+        if (!STRING_EQUALS(mode, "cold")) {
+            bench_warm(kbTypes[i], keys);
+        }
+        if (!STRING_EQUALS(mode, "warm")) {
+            bench_cold(kbTypes[i], keys);
+        }
+    }
+}
+
+static const struct {
+    const gchar *name;
+    void (*run)(GArray *keys);
+} suites[] = {
+    {"startup", bench_suite_startup},
+    {"first-key", bench_suite_first_key},
+    {"replay", bench_suite_replay},
+    {"dispatch", bench_suite_dispatch},
+    {"engine-new", bench_suite_engine_new},
+    {"keysym", bench_suite_keysym},
+    {NULL, NULL},
+};
+
+static gboolean kb_type_is_valid(const gchar *kbType) {
+    for (gint i = 0; kbTypes[i] != NULL; i++) {
+        if (STRING_EQUALS(kbType, kbTypes[i])) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static gboolean suite_is_valid(const gchar *suite) {
+    for (gint i = 0; suites[i].name != NULL; i++) {
+        if (STRING_EQUALS(suite, suites[i].name)) {
+            return TRUE;
+        }
+    }
+    return STRING_EQUALS(suite, "all");
+}
+
+gint main(gint argc, gchar **argv) {
+    g_autoptr(GError) error = NULL;
+    GOptionContext *context = g_option_context_new("- benchmark the ibus-chewing key path");
+
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("Option parsing failed: %s\n", error->message);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    const gchar *suite = (optSuite != NULL) ? optSuite : "all";
+
+    if (optKbType != NULL && !STRING_EQUALS(optKbType, "all") && !kb_type_is_valid(optKbType)) {
+        g_printerr("Unknown kb-type: %s\n", optKbType);
+        return 1;
+    }
+    if (optMode != NULL && !STRING_EQUALS(optMode, "warm") && !STRING_EQUALS(optMode, "cold") &&
+        !STRING_EQUALS(optMode, "both")) {
+        g_printerr("Unknown mode: %s\n", optMode);
+        return 1;
+    }
+    if (!suite_is_valid(suite)) {
+        g_printerr("Unknown suite: %s\n", suite);
+        return 1;
+    }
+    if (optStartupGap < 0) {
+        g_printerr("Startup gap should not be negative\n");
+        return 1;
+    }
+    if (optIterations < 1) {
+        g_printerr("Iterations should be at least 1\n");
+        return 1;
+    }
+
+    GArray *keys = corpus_load(optInput);
+
+    if (keys == NULL) {
+        return 1;
+    }
+    mkdg_log_set_level(WARN);
+
+    for (gint i = 0; suites[i].name != NULL; i++) {
+        if (STRING_EQUALS(suite, "all") || STRING_EQUALS(suite, suites[i].name)) {
+            suites[i].run(keys);
+        }
+    }
+    g_array_free(keys, TRUE);
+    return 0;
+}
@@ -3,12 +3,33 @@
 #include "ibus-chewing-engine.h"
 #include "test-util.h"
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <stdio.h>
 
 #define TEST_RUN_THIS(f) add_test_case("ibus-chewing-engine", f)
 
 static IBusChewingEngine *engine = NULL;
 
+/* Tests learn and remove phrases, keep them out of the real user-phrase DB */
+static gchar *userPath = NULL;
+
+static void user_path_remove() {
+    GDir *dir = g_dir_open(userPath, 0, NULL);
+    const gchar *name;
+
+    while (dir != NULL && (name = g_dir_read_name(dir)) != NULL) {
+        gchar *file = g_build_filename(userPath, name, NULL);
+
+        g_remove(file);
+        g_free(file);
+    }
+    if (dir != NULL) {
+        g_dir_close(dir);
+    }
+    g_rmdir(userPath);
+    g_clear_pointer(&userPath, g_free);
+}
+
 IBusChewingEngine *ibus_chewing_engine_new() {
     return (IBusChewingEngine *)g_object_new(IBUS_TYPE_CHEWING_ENGINE, NULL);
 }
@@ -74,14 +95,453 @@ void focus_out_then_focus_in_with_aux_text_clean_buffer_off_test() {
     focus_out_then_focus_in_with_aux_text_test();
 }
 
+void update_unchanged_ui_test() {
+    ibus_chewing_engine_focus_in(IBUS_ENGINE(engine));
+    ibus_chewing_engine_enable(IBUS_ENGINE(engine));
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    check_output("", "ㄨ", "");
+
+    /* Nothing changed, so nothing should be sent again */
+    IBusChewingEngineStats before = engine->stats;
+    ibus_chewing_engine_update(engine);
+    g_assert_cmpuint(engine->stats.updatesSent, ==, before.updatesSent);
+    g_assert_cmpuint(engine->stats.updatesSaved, ==, before.updatesSaved + 4);
+    check_output("", "ㄨ", "");
+
+    /* Focus in resends pre-edit even if unchanged */
+    ibus_chewing_engine_focus_in(IBUS_ENGINE(engine));
+    before = engine->stats;
+    ibus_chewing_engine_update(engine);
+    g_assert_cmpuint(engine->stats.updatesSent, >, before.updatesSent);
+
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+    ibus_chewing_engine_update(engine);
+    check_output("", "", "");
+}
+
+/* A text handed to IBus is never changed afterwards */
+void sent_texts_kept_test() {
+    ibus_chewing_engine_focus_in(IBUS_ENGINE(engine));
+    ibus_chewing_engine_enable(IBUS_ENGINE(engine));
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    check_output("", "ㄨ", "");
+    IBusText *sent = g_object_ref(engine->preEditText);
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, 0);
+    check_output("", "五", "");
+    g_assert(engine->preEditText != sent);
+    g_assert_cmpstr(sent->text, ==, "ㄨ");
+    g_object_unref(sent);
+
+    /* Nothing to send, nothing made */
+    guint64 objectsCreated = engine->stats.objectsCreated;
+
+    ibus_chewing_engine_update(engine);
+    g_assert_cmpuint(engine->stats.objectsCreated, ==, objectsCreated);
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Return, 0x1c, 0);
+    check_output("五", "", "");
+    g_assert(engine->preEditText == engine->emptyText);
+
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+}
+
+void caps_lock_tracking_test() {
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'a', 0x1e,
+                                          IBUS_LOCK_MASK | IBUS_RELEASE_MASK);
+    g_assert(mkdg_has_flag(engine->statusFlags, ENGINE_FLAG_CAPS_LOCK_KNOWN));
+    g_assert(mkdg_has_flag(engine->statusFlags, ENGINE_FLAG_CAPS_LOCK));
+
+    /* Pressing Caps_Lock flips the state it reports, the release is ignored */
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Caps_Lock, 0x3a,
+                                          IBUS_LOCK_MASK);
+    g_assert(!mkdg_has_flag(engine->statusFlags, ENGINE_FLAG_CAPS_LOCK));
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Caps_Lock, 0x3a,
+                                          IBUS_LOCK_MASK | IBUS_RELEASE_MASK);
+    g_assert(!mkdg_has_flag(engine->statusFlags, ENGINE_FLAG_CAPS_LOCK));
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Caps_Lock, 0x3a, 0);
+    g_assert(mkdg_has_flag(engine->statusFlags, ENGINE_FLAG_CAPS_LOCK));
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Caps_Lock, 0x3a,
+                                          IBUS_RELEASE_MASK);
+    g_assert(mkdg_has_flag(engine->statusFlags, ENGINE_FLAG_CAPS_LOCK));
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'a', 0x1e, IBUS_RELEASE_MASK);
+    g_assert(!mkdg_has_flag(engine->statusFlags, ENGINE_FLAG_CAPS_LOCK));
+
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+}
+
+/* Caps Lock already on when typing starts sets the mode from the first key */
+void caps_lock_first_key_test() {
+    IBusChewingEngine *fresh = ibus_chewing_engine_new();
+
+    g_object_set(G_OBJECT(fresh), "chi-eng-mode-toggle", "caps_lock", "sync-caps-lock",
+                 "keyboard", NULL);
+    ibus_chewing_engine_focus_in(IBUS_ENGINE(fresh));
+    ibus_chewing_engine_enable(IBUS_ENGINE(fresh));
+    g_assert(!mkdg_has_flag(fresh->statusFlags, ENGINE_FLAG_CAPS_LOCK_KNOWN));
+    ibus_chewing_pre_edit_set_chi_eng_mode(fresh->icPreEdit, TRUE);
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(fresh), 'j', 0x24, IBUS_LOCK_MASK);
+    g_assert(mkdg_has_flag(fresh->statusFlags, ENGINE_FLAG_CAPS_LOCK));
+    g_assert(!ibus_chewing_pre_edit_get_chi_eng_mode(fresh->icPreEdit));
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(fresh), 'j', 0x24,
+                                          IBUS_LOCK_MASK | IBUS_RELEASE_MASK);
+
+    /* Turned off while another input context had focus */
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(fresh), 'j', 0x24, 0);
+    g_assert(!mkdg_has_flag(fresh->statusFlags, ENGINE_FLAG_CAPS_LOCK));
+    g_assert(ibus_chewing_pre_edit_get_chi_eng_mode(fresh->icPreEdit));
+
+    ibus_chewing_engine_reset(IBUS_ENGINE(fresh));
+    g_object_unref(fresh);
+}
+
+void settings_applied_in_one_pass_test() {
+    guint64 settingsApplied = engine->stats.settingsApplied;
+
+    g_object_set(G_OBJECT(engine), "max-chi-symbol-len", 10, "cand-per-page", 7, "sel-keys",
+                 "asdfghjkl;", "space-as-selection", TRUE, NULL);
+    g_object_set(G_OBJECT(engine), "max-chi-symbol-len", 8, "cand-per-page", 5, "sel-keys",
+                 "1234567890", "space-as-selection", FALSE, NULL);
+    g_assert(engine->pendingSettings != 0);
+    g_assert_cmpuint(engine->stats.settingsApplied, ==, settingsApplied);
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    g_assert_cmpuint(engine->pendingSettings, ==, 0);
+    g_assert_cmpuint(engine->stats.settingsApplied, ==, settingsApplied + 1);
+    g_assert_cmpint(chewing_get_maxChiSymbolLen(engine->icPreEdit->context), ==, 8);
+    g_assert_cmpint(chewing_get_candPerPage(engine->icPreEdit->context), ==, 5);
+    g_assert_cmpint(chewing_get_spaceAsSelection(engine->icPreEdit->context), ==, 0);
+
+    /* Nothing pending, nothing applied */
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, 0);
+    g_assert_cmpuint(engine->stats.settingsApplied, ==, settingsApplied + 1);
+
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+}
+
+void english_pass_through_test() {
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+    ibus_chewing_pre_edit_set_chi_eng_mode(engine->icPreEdit, FALSE);
+    guint64 keysPassedThrough = engine->stats.keysPassedThrough;
+    guint64 updatesSent = engine->stats.updatesSent;
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, IBUS_RELEASE_MASK);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, IBUS_RELEASE_MASK);
+    g_assert_cmpuint(engine->stats.keysPassedThrough, ==, keysPassedThrough + 4);
+    g_assert_cmpuint(engine->stats.updatesSent, ==, updatesSent);
+    check_output("", "", "");
+
+    /* Releasing a lone Shift may toggle the mode, so it takes the full path */
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Shift_L, 0x2a, 0);
+    g_assert_cmpuint(engine->stats.keysPassedThrough, ==, keysPassedThrough + 5);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Shift_L, 0x2a,
+                                          IBUS_SHIFT_MASK | IBUS_RELEASE_MASK);
+    g_assert_cmpuint(engine->stats.keysPassedThrough, ==, keysPassedThrough + 5);
+
+    /* No pass-through in Chinese mode */
+    ibus_chewing_pre_edit_set_chi_eng_mode(engine->icPreEdit, TRUE);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    g_assert_cmpuint(engine->stats.keysPassedThrough, ==, keysPassedThrough + 5);
+    g_assert(!engine->icPreEdit->passThrough);
+
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+}
+
+void release_short_circuit_test() {
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+    g_object_set(G_OBJECT(engine), "chi-eng-mode-toggle", "shift", NULL);
+    ibus_chewing_pre_edit_set_chi_eng_mode(engine->icPreEdit, TRUE);
+    guint64 releases = engine->stats.releasesShortCircuited;
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    guint64 updatesSent = engine->stats.updatesSent;
+
+    g_assert(!ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24,
+                                                    IBUS_RELEASE_MASK));
+    g_assert_cmpuint(engine->stats.releasesShortCircuited, ==, releases + 1);
+    g_assert_cmpuint(engine->stats.updatesSent, ==, updatesSent);
+
+    /* Backspace release is absorbed while there is something to edit */
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_BackSpace, 0x0e, 0);
+    check_output("", "五", "");
+    g_assert(ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_BackSpace, 0x0e,
+                                                   IBUS_RELEASE_MASK));
+    g_assert_cmpuint(engine->stats.releasesShortCircuited, ==, releases + 2);
+
+    /* A lone Shift release still toggles the mode */
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Shift_L, 0x2a, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Shift_L, 0x2a,
+                                          IBUS_SHIFT_MASK | IBUS_RELEASE_MASK);
+    g_assert_cmpuint(engine->stats.releasesShortCircuited, ==, releases + 2);
+    g_assert(!ibus_chewing_pre_edit_get_chi_eng_mode(engine->icPreEdit));
+
+    ibus_chewing_pre_edit_set_chi_eng_mode(engine->icPreEdit, TRUE);
+    g_object_set(G_OBJECT(engine), "chi-eng-mode-toggle", "disable", NULL);
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+}
+
+void coalesce_ui_updates_test() {
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+    g_object_set(G_OBJECT(engine), "coalesce-ui-updates", TRUE, NULL);
+    guint64 updatesSent = engine->stats.updatesSent;
+    guint64 uiFlushes = engine->stats.uiFlushes;
+
+    /* A burst only changes the state */
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, 0);
+    g_assert_cmpuint(engine->stats.updatesSent, ==, updatesSent);
+    g_assert_cmpuint(engine->flushUiSource, !=, 0);
+
+    /* Then the UI is sent once */
+    while (g_main_context_iteration(NULL, FALSE)) {
+    }
+    g_assert_cmpuint(engine->stats.uiFlushes, ==, uiFlushes + 1);
+    g_assert_cmpuint(engine->flushUiSource, ==, 0);
+    check_output("", "我我", "");
+
+    /* A deferred commit goes out before the reset clears the buffer */
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Return, 0x1c, 0);
+    g_assert_cmpuint(engine->flushUiSource, !=, 0);
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+    g_assert_cmpuint(engine->stats.uiFlushes, ==, uiFlushes + 2);
+    g_assert_cmpuint(engine->flushUiSource, ==, 0);
+    g_assert_cmpstr(engine->outgoingText->text, ==, "我我");
+
+    /* So does one before the release of the key that committed it */
+    guint64 releases = engine->stats.releasesShortCircuited;
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Return, 0x1c, 0);
+    g_assert_cmpuint(engine->flushUiSource, !=, 0);
+    g_assert(!ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Return, 0x1c,
+                                                    IBUS_RELEASE_MASK));
+    g_assert_cmpuint(engine->stats.releasesShortCircuited, ==, releases + 1);
+    g_assert_cmpuint(engine->stats.uiFlushes, ==, uiFlushes + 3);
+    g_assert_cmpuint(engine->flushUiSource, ==, 0);
+    g_assert_cmpstr(engine->outgoingText->text, ==, "我");
+
+    g_object_set(G_OBJECT(engine), "coalesce-ui-updates", FALSE, NULL);
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+}
+
+void worker_thread_test() {
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+    g_object_set(G_OBJECT(engine), "worker-thread", TRUE, "worker-key-timeout", 1000, NULL);
+    g_assert(engine->worker != NULL);
+    guint64 keysLate = engine->stats.keysLate;
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, 0);
+    g_assert_cmpuint(engine->stats.keysLate, ==, keysLate);
+    g_assert(g_queue_is_empty(&engine->workerKeys));
+    check_output("", "我", "");
+    guint64 updatesSent = engine->stats.updatesSent;
+
+    g_assert(ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Return, 0x1c, 0));
+    /* Commit and pre-edit */
+    g_assert_cmpuint(engine->stats.updatesSent, ==, updatesSent + 2);
+    check_output("", "", "");
+
+    /* Answered in time or not, the keys end up in the same state */
+    g_object_set(G_OBJECT(engine), "worker-key-timeout", 1, NULL);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '3', 0x04, 0);
+    ibus_chewing_engine_worker_sync(engine);
+    g_assert(g_queue_is_empty(&engine->workerKeys));
+    while (g_main_context_iteration(NULL, FALSE)) {
+    }
+    check_output("", "我我", "");
+
+    g_object_set(G_OBJECT(engine), "worker-thread", FALSE, "worker-key-timeout", 50, NULL);
+    g_assert(engine->worker == NULL);
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+}
+
+void deferred_learning_test() {
+    ChewingContext *ctx = engine->icPreEdit->context;
+
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+    g_object_set(G_OBJECT(engine), "deferred-learning", TRUE, NULL);
+    ibus_chewing_engine_apply_settings(engine);
+    g_assert_cmpint(chewing_get_autoLearn(ctx), ==, AUTOLEARN_DISABLED);
+    chewing_userphrase_remove(ctx, "測試", "ㄘㄜˋ ㄕˋ");
+    guint64 phrasesLearned = engine->stats.phrasesLearned;
+
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'h', 0x23, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'k', 0x25, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '4', 0x05, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'g', 0x22, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '4', 0x05, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Return, 0x1c, 0);
+
+    /* Committed, but not learned until the flush */
+    g_assert_cmpuint(ibus_chewing_pre_edit_learn_pending(engine->icPreEdit), ==, 1);
+    g_assert(engine->learnSource != 0);
+    g_assert(!chewing_userphrase_lookup(ctx, "測試", "ㄘㄜˋ ㄕˋ"));
+
+    ibus_chewing_engine_focus_out(IBUS_ENGINE(engine));
+    g_assert_cmpuint(engine->stats.phrasesLearned, ==, phrasesLearned + 1);
+    g_assert_cmpuint(ibus_chewing_pre_edit_learn_pending(engine->icPreEdit), ==, 0);
+    g_assert(engine->learnSource == 0);
+    g_assert(chewing_userphrase_lookup(ctx, "測試", "ㄘㄜˋ ㄕˋ"));
+
+    chewing_userphrase_remove(ctx, "測試", "ㄘㄜˋ ㄕˋ");
+
+    /* A single character is learned too, as libchewing would */
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'h', 0x23, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'k', 0x25, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '4', 0x05, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Return, 0x1c, 0);
+    g_assert_cmpuint(ibus_chewing_pre_edit_learn_pending(engine->icPreEdit), ==, 1);
+    ibus_chewing_engine_flush_learning(engine);
+    g_assert_cmpuint(engine->stats.phrasesLearned, ==, phrasesLearned + 2);
+
+    g_object_set(G_OBJECT(engine), "deferred-learning", FALSE, NULL);
+    ibus_chewing_engine_apply_settings(engine);
+    g_assert_cmpint(chewing_get_autoLearn(ctx), ==, AUTOLEARN_ENABLED);
+    ibus_chewing_engine_focus_in(IBUS_ENGINE(engine));
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+}
+
+static void commit_test_phrase() {
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'h', 0x23, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'k', 0x25, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '4', 0x05, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'g', 0x22, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '4', 0x05, 0);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), IBUS_KEY_Return, 0x1c, 0);
+}
+
+/* A full queue is learned once idle and drops its oldest phrase meanwhile */
+void deferred_learning_queue_full_test() {
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+    g_object_set(G_OBJECT(engine), "deferred-learning", TRUE, NULL);
+    ibus_chewing_engine_apply_settings(engine);
+    guint64 phrasesLearned = engine->stats.phrasesLearned;
+
+    for (guint i = 0; i <= IBUS_CHEWING_LEARN_QUEUE_MAX; i++) {
+        commit_test_phrase();
+    }
+    g_assert_cmpuint(ibus_chewing_pre_edit_learn_pending(engine->icPreEdit), ==,
+                     IBUS_CHEWING_LEARN_QUEUE_MAX);
+    g_assert_cmpuint(engine->stats.phrasesLearned, ==, phrasesLearned);
+    g_assert(engine->learnSoon);
+
+    while (g_main_context_iteration(NULL, FALSE)) {
+    }
+    g_assert_cmpuint(engine->stats.phrasesLearned, ==,
+                     phrasesLearned + IBUS_CHEWING_LEARN_QUEUE_MAX);
+    g_assert_cmpuint(ibus_chewing_pre_edit_learn_pending(engine->icPreEdit), ==, 0);
+    g_assert(engine->learnSource == 0);
+
+    /* The worker learns, the main loop only queues it */
+    g_object_set(G_OBJECT(engine), "worker-thread", TRUE, NULL);
+    commit_test_phrase();
+    ibus_chewing_engine_flush_learning(engine);
+    g_assert(!g_queue_is_empty(&engine->workerKeys));
+    ibus_chewing_engine_worker_sync(engine);
+    g_assert_cmpuint(engine->stats.phrasesLearned, ==,
+                     phrasesLearned + IBUS_CHEWING_LEARN_QUEUE_MAX + 1);
+    g_assert_cmpuint(ibus_chewing_pre_edit_learn_pending(engine->icPreEdit), ==, 0);
+
+    g_object_set(G_OBJECT(engine), "worker-thread", FALSE, NULL);
+    chewing_userphrase_remove(engine->icPreEdit->context, "測試", "ㄘㄜˋ ㄕˋ");
+    g_object_set(G_OBJECT(engine), "deferred-learning", FALSE, NULL);
+    ibus_chewing_engine_apply_settings(engine);
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+}
+
+void focus_bounce_test() {
+    gboolean cleanBufferFocusOut;
+
+    g_object_get(G_OBJECT(engine), "clean-buffer-focus-out", &cleanBufferFocusOut, NULL);
+    g_object_set(G_OBJECT(engine), "clean-buffer-focus-out", FALSE, NULL);
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+    ibus_chewing_engine_focus_in(IBUS_ENGINE(engine));
+    ibus_chewing_engine_enable(IBUS_ENGINE(engine));
+    g_assert(engine->statusFlags & ENGINE_FLAG_PROPERTIES_REGISTERED);
+    check_output("", "", "");
+
+    /* Nothing changed while focus was away: no refresh, nothing to clear */
+    IBusChewingEngineStats before = engine->stats;
+
+    ibus_chewing_engine_focus_out(IBUS_ENGINE(engine));
+    ibus_chewing_engine_focus_in(IBUS_ENGINE(engine));
+    g_assert(engine->statusFlags & ENGINE_FLAG_PROPERTIES_REGISTERED);
+    g_assert_cmpuint(engine->stats.propertyUpdatesSaved, >=, before.propertyUpdatesSaved + 3);
+    g_assert_cmpuint(engine->stats.focusClearsSkipped, ==, before.focusClearsSkipped + 1);
+
+    /* Only the property that changed is refreshed */
+    before = engine->stats;
+    ibus_chewing_pre_edit_set_chi_eng_mode(engine->icPreEdit, FALSE);
+    ibus_chewing_engine_refresh_property_list(engine);
+    g_assert_cmpuint(engine->stats.propertyUpdatesSaved, ==, before.propertyUpdatesSaved + 2);
+    g_assert(!engine->lastPropChinese);
+
+    /* Something typed is still cleared */
+    ibus_chewing_pre_edit_set_chi_eng_mode(engine->icPreEdit, TRUE);
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), 'j', 0x24, 0);
+    check_output("", "ㄨ", "");
+    before = engine->stats;
+    ibus_chewing_engine_focus_out(IBUS_ENGINE(engine));
+    ibus_chewing_engine_focus_in(IBUS_ENGINE(engine));
+    g_assert_cmpuint(engine->stats.focusClearsSkipped, ==, before.focusClearsSkipped);
+    check_output("", "", "");
+
+    /* So is a candidate table opened over an empty pre-edit */
+    ibus_chewing_engine_process_key_event(IBUS_ENGINE(engine), '`', 0x29, 0);
+    g_assert(ibus_chewing_pre_edit_has_flag(engine->icPreEdit, FLAG_TABLE_SHOW));
+    before = engine->stats;
+    ibus_chewing_engine_focus_out(IBUS_ENGINE(engine));
+    ibus_chewing_engine_focus_in(IBUS_ENGINE(engine));
+    g_assert_cmpuint(engine->stats.focusClearsSkipped, ==, before.focusClearsSkipped);
+    g_assert(!ibus_chewing_pre_edit_has_flag(engine->icPreEdit, FLAG_TABLE_SHOW));
+    check_output("", "", "");
+
+    g_object_set(G_OBJECT(engine), "clean-buffer-focus-out", cleanBufferFocusOut, NULL);
+    ibus_chewing_engine_reset(IBUS_ENGINE(engine));
+}
+
 gint main(gint argc, gchar **argv) {
     g_test_init(&argc, &argv, NULL);
     mkdg_log_set_level(DEBUG);
+    userPath = g_dir_make_tmp("ibus-chewing-engine-test-XXXXXX", NULL);
+    g_assert(userPath != NULL);
+    g_setenv("CHEWING_USER_PATH", userPath, TRUE);
     engine = ibus_chewing_engine_new();
 
     g_object_set(G_OBJECT(engine), "max-chi-symbol-len", 8, NULL);
     TEST_RUN_THIS(focus_out_then_focus_in_with_aux_text_clean_buffer_off_test);
     TEST_RUN_THIS(focus_out_then_focus_in_with_aux_text_clean_buffer_on_test);
+    TEST_RUN_THIS(update_unchanged_ui_test);
+    TEST_RUN_THIS(sent_texts_kept_test);
+    TEST_RUN_THIS(caps_lock_tracking_test);
+    TEST_RUN_THIS(caps_lock_first_key_test);
+    TEST_RUN_THIS(settings_applied_in_one_pass_test);
+    TEST_RUN_THIS(english_pass_through_test);
+    TEST_RUN_THIS(release_short_circuit_test);
+    TEST_RUN_THIS(coalesce_ui_updates_test);
+    TEST_RUN_THIS(worker_thread_test);
+    TEST_RUN_THIS(deferred_learning_test);
+    TEST_RUN_THIS(deferred_learning_queue_full_test);
+    TEST_RUN_THIS(focus_bounce_test);
+
+    gint ret = g_test_run();
 
-    return g_test_run();
+    g_object_unref(engine);
+    user_path_remove();
+    return ret;
 }